@@ -0,0 +1,229 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+/*-----------------------------------------------------------
+Loads the six faces of a cube map (or any set of textures
+that is needed before the first frame) on worker threads,
+builds their mip chains in parallel and uploads everything
+through a single pixel buffer object.
+
+The faces of one cube must all have the same size and depth.
+-------------------------------------------------------------*/
+
+#include <windows.h>
+#include "Dependencies\glew\glew.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+#include <atomic>
+#include <vector>
+
+#include "tga.h"
+#include "cubemap.h"
+
+// seconds since an arbitrary point, for the load time reports
+double cubeSeconds(void) {
+
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+// loads count TGA files, nThreads at a time. nThreads <= 0 uses
+// every core, 1 is the old one after the other behaviour. Files that
+// fail are reported and left with a NULL or error status image.
+// Returns the number of threads actually used
+int cubeLoadImages(char *filenames[], int count, tgaInfo *images[], int nThreads) {
+
+	std::atomic<int> next(0);
+	std::vector<std::thread> workers;
+	int i;
+
+	if (nThreads <= 0)
+		nThreads = max((int)std::thread::hardware_concurrency(), 1);
+
+	for (i = 0; i < min(nThreads, count); i++) {
+		workers.push_back(std::thread([&]() {
+			for (int f = next++; f < count; f = next++)
+				images[f] = tgaLoad(filenames[f]);
+		}));
+	}
+	for (i = 0; i < (int)workers.size(); i++)
+		workers[i].join();
+
+	for (i = 0; i < count; i++) {
+		if (images[i] == NULL || images[i]->status != TGA_OK)
+			printf("Error loading %s\n", filenames[i]);
+	}
+	return((int)workers.size());
+}
+
+// groups six loaded faces, checking that they can form a cube
+cubeInfo* cubeFromImages(tgaInfo *faces[6]) {
+
+	cubeInfo *cube;
+	int i;
+
+	cube = (cubeInfo *)calloc(1, sizeof(cubeInfo));
+	if (cube == NULL)
+		return(NULL);
+
+	for (i = 0; i < 6; i++) {
+		cube->faces[i] = faces[i];
+		if (faces[i] == NULL || faces[i]->status != TGA_OK) {
+			cube->status = CUBE_ERROR_LOADING;
+			return(cube);
+		}
+	}
+
+	cube->width = faces[0]->width;
+	cube->height = faces[0]->height;
+	cube->components = faces[0]->pixelDepth / 8;
+	for (i = 1; i < 6; i++) {
+		if (faces[i]->width != cube->width || faces[i]->height != cube->height || faces[i]->pixelDepth != faces[0]->pixelDepth) {
+			printf("Cube face %d is %dx%dx%d, expected %dx%dx%d\n", i, faces[i]->width, faces[i]->height, faces[i]->pixelDepth,
+				cube->width, cube->height, faces[0]->pixelDepth);
+			cube->status = CUBE_ERROR_SIZE_MISMATCH;
+			return(cube);
+		}
+	}
+
+	cube->levels = 1;
+	for (i = 0; i < 6; i++)
+		cube->mipData[i][0] = faces[i]->imageData;
+
+	cube->status = CUBE_OK;
+	return(cube);
+}
+
+// halves one level with a 2x2 box filter
+static void cubeDownsample(const unsigned char *src, int width, int height, unsigned char *dst, int components) {
+
+	int newWidth = max(width / 2, 1), newHeight = max(height / 2, 1);
+	int x, y, c;
+
+	for (y = 0; y < newHeight; y++) {
+		const unsigned char *row0 = src + (min(2 * y, height - 1) * width) * components;
+		const unsigned char *row1 = src + (min(2 * y + 1, height - 1) * width) * components;
+		for (x = 0; x < newWidth; x++) {
+			int x0 = min(2 * x, width - 1) * components, x1 = min(2 * x + 1, width - 1) * components;
+			for (c = 0; c < components; c++)
+				*dst++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+}
+
+// builds the full mip chain of every face, one face per thread
+void cubeBuildMipmaps(cubeInfo *cube) {
+
+	std::vector<std::thread> workers;
+	int i, levels = 1;
+	double start = cubeSeconds();
+
+	if (cube->status != CUBE_OK)
+		return;
+
+	while (levels < CUBE_MAX_LEVELS && ((cube->width >> (levels - 1)) > 1 || (cube->height >> (levels - 1)) > 1))
+		levels++;
+
+	for (i = 0; i < 6; i++) {
+		workers.push_back(std::thread([cube, levels, i]() {
+			int width = cube->width, height = cube->height;
+			for (int level = 1; level < levels; level++) {
+				int newWidth = max(width / 2, 1), newHeight = max(height / 2, 1);
+				cube->mipData[i][level] = (unsigned char *)malloc(newWidth * newHeight * cube->components);
+				cubeDownsample(cube->mipData[i][level - 1], width, height, cube->mipData[i][level], cube->components);
+				width = newWidth;
+				height = newHeight;
+			}
+		}));
+	}
+	for (i = 0; i < 6; i++)
+		workers[i].join();
+
+	cube->levels = levels;
+	cube->mipTime = cubeSeconds() - start;
+}
+
+// uploads every face and level. All the pixels are copied into one
+// pixel buffer object and the glTexImage2D calls read from offsets in it
+void cubeUpload(cubeInfo *cube, GLenum bindTarget, const GLuint textures[6], const GLenum faceTargets[6]) {
+
+	GLenum format = cube->components == 4 ? GL_RGBA : (cube->components == 3 ? GL_RGB : GL_LUMINANCE);
+	size_t offsets[6][CUBE_MAX_LEVELS];
+	size_t total = 0;
+	GLuint pbo = 0;
+	unsigned char *base = NULL;
+	int i, level;
+	double start = cubeSeconds();
+
+	if (cube->status != CUBE_OK)
+		return;
+
+	for (i = 0; i < 6; i++) {
+		for (level = 0; level < cube->levels; level++) {
+			offsets[i][level] = total;
+			total += max(cube->width >> level, 1) * max(cube->height >> level, 1) * cube->components;
+		}
+	}
+
+	if (GLEW_ARB_pixel_buffer_object) {
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+		base = (unsigned char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		if (base != NULL) {
+			for (i = 0; i < 6; i++)
+				for (level = 0; level < cube->levels; level++)
+					memcpy(base + offsets[i][level], cube->mipData[i][level],
+						max(cube->width >> level, 1) * max(cube->height >> level, 1) * cube->components);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &pbo);
+			pbo = 0;
+		}
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (i = 0; i < 6; i++) {
+		glBindTexture(bindTarget, textures[i]);
+		for (level = 0; level < cube->levels; level++) {
+			const GLvoid *pixels = pbo != 0 ? (const GLvoid *)offsets[i][level] : (const GLvoid *)cube->mipData[i][level];
+			glTexImage2D(faceTargets[i], level, cube->components, max(cube->width >> level, 1), max(cube->height >> level, 1), 0,
+				format, GL_UNSIGNED_BYTE, pixels);
+		}
+	}
+
+	if (pbo != 0) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glDeleteBuffers(1, &pbo);
+	}
+
+	// the cube is only ready for the first frame once the driver is done with it
+	glFinish();
+	cube->uploadTime = cubeSeconds() - start;
+}
+
+// releases the faces and the mip levels
+void cubeDestroy(cubeInfo *cube) {
+
+	int i, level;
+
+	if (cube == NULL)
+		return;
+
+	for (i = 0; i < 6; i++) {
+		for (level = 1; level < cube->levels; level++)
+			free(cube->mipData[i][level]);
+		// images that failed to load have no pixels to release
+		if (cube->faces[i] != NULL && cube->faces[i]->status != TGA_OK)
+			free(cube->faces[i]);
+		else
+			tgaDestroy(cube->faces[i]);
+	}
+	free(cube);
+}
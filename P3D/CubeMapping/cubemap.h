@@ -0,0 +1,29 @@
+#pragma once
+
+#define CUBE_OK						 0
+#define CUBE_ERROR_LOADING			-1
+#define CUBE_ERROR_SIZE_MISMATCH	-2
+
+#define CUBE_MAX_LEVELS				16
+
+
+typedef struct {
+	int status;
+	int width, height, components;
+	int levels;
+	tgaInfo *faces[6];
+	unsigned char *mipData[6][CUBE_MAX_LEVELS];
+	double mipTime, uploadTime;
+}cubeInfo;
+
+int cubeLoadImages(char *filenames[], int count, tgaInfo *images[], int nThreads);
+
+cubeInfo* cubeFromImages(tgaInfo *faces[6]);
+
+void cubeBuildMipmaps(cubeInfo *cube);
+
+void cubeUpload(cubeInfo *cube, GLenum bindTarget, const GLuint textures[6], const GLenum faceTargets[6]);
+
+double cubeSeconds(void);
+
+void cubeDestroy(cubeInfo *cube);
@@ -5,10 +5,13 @@
 #define GL_MULTISAMPLE_ARB  0x809D
 #endif
 
+#include "Dependencies\glew\glew.h"
 #include "Dependencies\freeglut\freeglut.h"
 #include <stdio.h>
+#include <string.h>
 #include <windows.h>
 #include "tga.h"
+#include "cubemap.h"
 
 /* In case your <GL/gl.h> does not advertise EXT_texture_cube_map... */
 #ifndef GL_EXT_texture_cube_map
@@ -44,13 +47,12 @@ void pressNormalKeys(unsigned char key, int x, int y);
 void display(void);
 void reshape(GLsizei w, GLsizei h);
 void funcmyDL(void);
-void load_bkg_image(void);
-void load_cube_map_images(void);
+void load_bkg_image(tgaInfo *imbkg);
+void load_cube_map_images(cubeInfo *cube, GLuint *texture);
+void load_all_images(int nThreads);
 
 
 // Variveis globais
-tgaInfo *imbkg;
-tgaInfo *im[6];
 GLuint texturebkg;
 GLuint texture1, texture2;
 int myDL;
@@ -186,13 +188,8 @@ void funcmyDL(void)
 }
 
 
-void load_bkg_image(void)
+void load_bkg_image(tgaInfo *imbkg)
 {
-	char *impathfile = "back.tga";
-
-	// Carrega a imagem de textura
-	imbkg = tgaLoad(impathfile);
-
 	// allocate a texture names
 	glGenTextures(1, &texturebkg);
 
@@ -213,32 +210,21 @@ void load_bkg_image(void)
 }
 
 
-void load_cube_map_images(void)
+void load_cube_map_images(cubeInfo *cube, GLuint *texture)
 {
-	char *impathfile[6] = { "xpos.tga", "xneg.tga", "ypos.tga", "yneg.tga", "zpos.tga", "zneg.tga" };
+	GLuint textures[6];
 	int i;
 
-	// Carrega as imagens de textura
-	for (i = 0; i<6; i++)
-	{
-		im[i] = tgaLoad(impathfile[i]);
-
-		printf("IMAGE INFO: %s\nstatus: %d\ntype: %d\npixelDepth: %d\nsize%d x %d\n", impathfile[i], im[i]->status, im[i]->type, im[i]->pixelDepth, im[i]->width, im[i]->height); fflush(stdout);
-	}
-
 	// allocate a texture name
-	glGenTextures(1, &texture1);
+	glGenTextures(1, texture);
+	for (i = 0; i<6; i++) textures[i] = *texture;
 
-	// select our current texture
-	glBindTexture(GL_TEXTURE_CUBE_MAP_EXT, texture1);
+	// Carrega as imagens (e respetivos mipmaps) para as vrias faces da textura
+	cubeUpload(cube, GL_TEXTURE_CUBE_MAP_EXT, textures, faceTarget);
 
-	// Carrega as imagens para as vrias faces da textura
-	for (i = 0; i<6; i++)
-	{
-		glTexImage2D(faceTarget[i], 0, GL_RGBA, im[i]->width, im[i]->height, 0, GL_RGB, GL_UNSIGNED_BYTE, im[i]->imageData);
-	}
+	glBindTexture(GL_TEXTURE_CUBE_MAP_EXT, *texture);
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP_EXT, GL_TEXTURE_MIN_FILTER, cube->levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_CUBE_MAP_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
 	glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP_EXT);
@@ -246,48 +232,48 @@ void load_cube_map_images(void)
 	glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP_EXT);
 
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-
-	// Destroi as imagens
-	for (i = 0; i<6; i++) tgaDestroy(im[i]);
 }
 
 
-void load_cube_map2_images(void)
+// Carrega as imagens das duas cube maps e do fundo em paralelo, e mede o tempo at estarem prontas
+void load_all_images(int nThreads)
 {
-	char *impathfile[6] = { "cm_front.tga", "cm_back.tga", "cm_right.tga", "cm_left.tga", "cm_top.tga", "cm_bottom.tga" };
-	int i;
-
-	// Carrega as imagens de textura
-	for (i = 0; i<6; i++)
-	{
-		im[i] = tgaLoad(impathfile[i]);
-
-		printf("IMAGE INFO: %s\nstatus: %d\ntype: %d\npixelDepth: %d\nsize%d x %d\n", impathfile[i], im[i]->status, im[i]->type, im[i]->pixelDepth, im[i]->width, im[i]->height); fflush(stdout);
-	}
-
-	// allocate a texture name
-	glGenTextures(1, &texture2);
-
-	// select our current texture
-	glBindTexture(GL_TEXTURE_CUBE_MAP_EXT, texture2);
-
-	// Carrega as imagens para as vrias faces da textura
-	for (i = 0; i<6; i++)
+	char *impathfile[13] = { "xpos.tga", "xneg.tga", "ypos.tga", "yneg.tga", "zpos.tga", "zneg.tga",
+		"cm_front.tga", "cm_back.tga", "cm_right.tga", "cm_left.tga", "cm_top.tga", "cm_bottom.tga",
+		"back.tga" };
+	tgaInfo *images[13] = { NULL };
+	cubeInfo *cube1, *cube2;
+	double start, loadTime;
+
+	start = cubeSeconds();
+
+	// Leitura e converso BGR -> RGB de todas as imagens ao mesmo tempo
+	nThreads = cubeLoadImages(impathfile, 13, images, nThreads);
+	loadTime = cubeSeconds() - start;
+
+	cube1 = cubeFromImages(&images[0]);
+	cube2 = cubeFromImages(&images[6]);
+	if (cube1->status != CUBE_OK || cube2->status != CUBE_OK || images[12] == NULL || images[12]->status != TGA_OK)
 	{
-		glTexImage2D(faceTarget[i], 0, GL_RGBA, im[i]->width, im[i]->height, 0, GL_RGB, GL_UNSIGNED_BYTE, im[i]->imageData);
+		printf("Erro ao carregar as cube maps\n");
+		exit(1);
 	}
 
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_EXT, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP_EXT, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	// Mipmaps das seis faces em paralelo
+	cubeBuildMipmaps(cube1);
+	cubeBuildMipmaps(cube2);
 
-	glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP_EXT);
-	glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP_EXT);
-	glTexGeni(GL_R, GL_TEXTURE_GEN_MODE, GL_REFLECTION_MAP_EXT);
+	load_bkg_image(images[12]);
+	load_cube_map_images(cube1, &texture1);
+	load_cube_map_images(cube2, &texture2);
 
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	printf("Cube maps prontas em %.1f ms (%d threads): leitura %.1f ms, mipmaps %.1f ms, upload %.1f ms\n",
+		(cubeSeconds() - start) * 1000.0, nThreads, loadTime * 1000.0,
+		(cube1->mipTime + cube2->mipTime) * 1000.0, (cube1->uploadTime + cube2->uploadTime) * 1000.0);
+	fflush(stdout);
 
-	// Destroi as imagens
-	for (i = 0; i<6; i++) tgaDestroy(im[i]);
+	cubeDestroy(cube1);
+	cubeDestroy(cube2);
 }
 
 
@@ -302,11 +288,13 @@ int main(int argc, char** argv)
 	glutInitWindowSize(640, 480);
 	glutCreateWindow("Programa-24");
 
+	// Necessrio para os pixel buffer objects
+	glewInit();
+
 	// Inicializaes
 	init();
-	load_bkg_image();
-	load_cube_map_images();
-	load_cube_map2_images();
+	// "-serial" carrega as imagens uma a uma, para comparar o tempo de arranque
+	load_all_images(argc > 1 && strcmp(argv[1], "-serial") == 0 ? 1 : 0);
 	initDL();
 
 	// Registar funes de callback
@@ -1,66 +1,306 @@
-#include <gl\gl.h>
-#include <gl\glut.h>
+#include <windows.h>
+#include <stdio.h>
+#include <setjmp.h>
+#include "Dependencies\freeglut\freeglut.h"
+
+#include <thread>
+#include <atomic>
+#include <vector>
 
 #include "jpeg.h"
 
+// A read only view of a whole file, so libjpeg can decode straight from the page cache
+typedef struct {
+	HANDLE hFile, hMapping;
+	const unsigned char *data;
+	unsigned long size;
+}tMappedFile;
+
+static bool SwiftMapFile(const char *strFileName, tMappedFile *pMapped)
+{
+	pMapped->hFile = CreateFileA(strFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (pMapped->hFile == INVALID_HANDLE_VALUE){
+		return false;
+	}
+
+	pMapped->size = GetFileSize(pMapped->hFile, NULL);
+	pMapped->hMapping = CreateFileMapping(pMapped->hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (pMapped->hMapping == NULL){
+		CloseHandle(pMapped->hFile);
+		return false;
+	}
+
+	pMapped->data = (const unsigned char*)MapViewOfFile(pMapped->hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (pMapped->data == NULL){
+		CloseHandle(pMapped->hMapping);
+		CloseHandle(pMapped->hFile);
+		return false;
+	}
+	return true;
+}
+
+static void SwiftUnmapFile(tMappedFile *pMapped)
+{
+	UnmapViewOfFile(pMapped->data);
+	CloseHandle(pMapped->hMapping);
+	CloseHandle(pMapped->hFile);
+}
+
+// libjpeg's default error handler exit()s the process; this one jumps back to the decoder
+// instead, so a corrupt file only fails its own decode (even on a batch worker thread)
+typedef struct {
+	jpeg_error_mgr pub;
+	jmp_buf setjmpBuffer;
+}tJpegError;
+
+static void SwiftJpegErrorExit(j_common_ptr cInfo)
+{
+	tJpegError *pError = (tJpegError*)cInfo->err;
+	(*cInfo->err->output_message)(cInfo);
+	longjmp(pError->setjmpBuffer, 1);
+}
+
+// Reads only the header to know the full resolution size
+static bool SwiftJpegSize(const unsigned char *buffer, unsigned long size, int *width, int *height)
+{
+	struct jpeg_decompress_struct cInfo;
+	tJpegError jerr;
+
+	cInfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = SwiftJpegErrorExit;
+	if (setjmp(jerr.setjmpBuffer)){
+		jpeg_destroy_decompress(&cInfo);
+		return false;
+	}
+	jpeg_create_decompress(&cInfo);
+	jpeg_mem_src(&cInfo, (unsigned char*)buffer, size);
+	bool ok = jpeg_read_header(&cInfo, true) == JPEG_HEADER_OK;
+	*width = cInfo.image_width;
+	*height = cInfo.image_height;
+	jpeg_destroy_decompress(&cInfo);
+
+	return ok;
+}
+
+// Largest DCT scale denominator whose output still covers the target size
+static int SwiftJpegScaleFor(int width, int height, int targetWidth, int targetHeight)
+{
+	int denom = 1;
+	if (targetWidth <= 0 && targetHeight <= 0){
+		return denom;
+	}
+	while (denom < 8 && (width + denom * 2 - 1) / (denom * 2) >= targetWidth && (height + denom * 2 - 1) / (denom * 2) >= targetHeight){
+		denom *= 2;
+	}
+	return denom;
+}
+
+static double SwiftSeconds(void)
+{
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+
+static bool SwiftIsPowerOfTwo(int n)
+{
+	return n > 0 && (n & (n - 1)) == 0;
+}
+
+// Halves the image in place with a 2x2 box filter (a 1 pixel side stays as it is)
+static void SwiftHalveImage(tImageJPG *pImage)
+{
+	int width = max(pImage->sizeX / 2, 1), height = max(pImage->sizeY / 2, 1);
+	int stepX = pImage->sizeX > 1 ? 3 : 0, stepY = pImage->sizeY > 1 ? pImage->rowSpan : 0;
+	unsigned char *pData = new unsigned char[width * height * 3];
+
+	for (int y = 0; y < height; y++){
+		const unsigned char *pRow = &pImage->data[y * 2 * pImage->rowSpan];
+		unsigned char *pOut = &pData[y * width * 3];
+		for (int x = 0; x < width; x++){
+			const unsigned char *p = &pRow[x * 2 * 3];
+			for (int c = 0; c < 3; c++){
+				pOut[x * 3 + c] = (unsigned char)((p[c] + p[stepX + c] + p[stepY + c] + p[stepY + stepX + c] + 2) / 4);
+			}
+		}
+	}
+
+	delete [] pImage->data;
+	pImage->data = pData;
+	pImage->sizeX = width;
+	pImage->sizeY = height;
+	pImage->rowSpan = width * 3;
+}
+
 void SwiftTextureJpeg(unsigned int tTexture[], LPSTR strFileName, int ID) {
-	
-	tImageJPG *pBitMap = SwiftLoadJpeg(strFileName);
+
+	tMappedFile file;
+	if (!SwiftMapFile(strFileName, &file)){
+		return;
+	}
+
+	// The file is decoded once, at full resolution; every mip level comes from that image
+	tImageJPG *pBitMap = SwiftDecodeJpeg(file.data, file.size, 1);
+	SwiftUnmapFile(&file);
+	if (pBitMap == NULL){
+		return;
+	}
 
 	glGenTextures(1, &tTexture[ID]);
 	glBindTexture(GL_TEXTURE_2D, tTexture[ID]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	if (!SwiftIsPowerOfTwo(pBitMap->sizeX) || !SwiftIsPowerOfTwo(pBitMap->sizeY)){
+		// gluBuild2DMipmaps rescales non power of two images to a power of two first
+		gluBuild2DMipmaps(GL_TEXTURE_2D, 3, pBitMap->sizeX, pBitMap->sizeY, GL_RGB, GL_UNSIGNED_BYTE, pBitMap->data);
+	}
+	else{
+		int level = 0;
+		glTexImage2D(GL_TEXTURE_2D, level, 3, pBitMap->sizeX, pBitMap->sizeY, 0, GL_RGB, GL_UNSIGNED_BYTE, pBitMap->data);
+
+		// Each level is the previous one box filtered down to half its size
+		while (pBitMap->sizeX > 1 || pBitMap->sizeY > 1){
+			SwiftHalveImage(pBitMap);
+			glTexImage2D(GL_TEXTURE_2D, ++level, 3, pBitMap->sizeX, pBitMap->sizeY, 0, GL_RGB, GL_UNSIGNED_BYTE, pBitMap->data);
+		}
+	}
 
-	gluBuild2DMipmaps(GL_TEXTURE_2D, 3, pBitMap->sizeX, pBitMap->sizeY, GL_RGB, GL_UNSIGNED_BYTE, pBitMap->data);
-	
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR_MIPMAP_LINEAR);
 
-	free(pBitMap->data);			
-	free(pBitMap);
+	SwiftFreeJpeg(pBitMap);
 }
 
 tImageJPG *SwiftLoadJpeg(const char *strFileName)
-{	
-	FILE *pFile;
-	struct jpeg_decompress_struct cInfo;
+{
+	return SwiftLoadJpegScaled(strFileName, 0, 0);
+}
+
+tImageJPG *SwiftLoadJpegScaled(const char *strFileName, int targetWidth, int targetHeight)
+{
+	tMappedFile file;
+	int width, height;
 	tImageJPG *pImageData = NULL;
-	jpeg_error_mgr jerr;
 
-	if ((pFile = fopen(strFileName, "rb")) == NULL){
+	if (!SwiftMapFile(strFileName, &file)){
 		return 0;
 	}
 
-	cInfo.err = jpeg_std_error(&jerr);
+	if (SwiftJpegSize(file.data, file.size, &width, &height)){
+		pImageData = SwiftDecodeJpeg(file.data, file.size, SwiftJpegScaleFor(width, height, targetWidth, targetHeight));
+	}
+
+	SwiftUnmapFile(&file);
+
+	return pImageData;
+}
+
+tImageJPG *SwiftDecodeJpeg(const unsigned char *buffer, unsigned long size, int scaleDenom)
+{
+	struct jpeg_decompress_struct cInfo;
+	// volatile: they are changed after setjmp and read again after a longjmp
+	tImageJPG * volatile pImageData = NULL;
+	unsigned char ** volatile rowPtr = NULL;
+	tJpegError jerr;
+
+	cInfo.err = jpeg_std_error(&jerr.pub);
+	jerr.pub.error_exit = SwiftJpegErrorExit;
+	if (setjmp(jerr.setjmpBuffer)){
+		// A corrupt or truncated file: give up on it only
+		delete [] rowPtr;
+		SwiftFreeJpeg(pImageData);
+		jpeg_destroy_decompress(&cInfo);
+		return 0;
+	}
 	jpeg_create_decompress(&cInfo);
-	jpeg_stdio_src(&cInfo, pFile);
-	jpeg_read_header(&cInfo, true);
+	jpeg_mem_src(&cInfo, (unsigned char*)buffer, size);
+	if (jpeg_read_header(&cInfo, true) != JPEG_HEADER_OK){
+		jpeg_destroy_decompress(&cInfo);
+		return 0;
+	}
+
+	// The IDCT produces the reduced size directly, no full resolution pass is done
+	cInfo.scale_num = 1;
+	cInfo.scale_denom = scaleDenom;
+	cInfo.out_color_space = JCS_RGB;
 	jpeg_start_decompress(&cInfo);
 
 	pImageData = (tImageJPG*)malloc(sizeof(tImageJPG));
+	pImageData->data = NULL;
+
+	pImageData->rowSpan = cInfo.output_width * cInfo.output_components;
+	pImageData->sizeX   = cInfo.output_width;
+	pImageData->sizeY   = cInfo.output_height;
 
-	pImageData->rowSpan = cInfo.image_width * cInfo.num_components;
-	pImageData->sizeX   = cInfo.image_width;
-	pImageData->sizeY   = cInfo.image_height;
-	
 	pImageData->data = new unsigned char[pImageData->rowSpan * pImageData->sizeY];
-	
-	unsigned char** rowPtr = new unsigned char*[pImageData->sizeY];
+
+	// Rows are stored bottom up, as OpenGL expects them
+	rowPtr = new unsigned char*[pImageData->sizeY];
 	for (int i = 0; i < pImageData->sizeY; i++){
-		rowPtr[i] = &(pImageData->data[i*pImageData->rowSpan]);
+		rowPtr[i] = &(pImageData->data[(pImageData->sizeY - 1 - i)*pImageData->rowSpan]);
 	}
-	
-	int rowsRead = cInfo.output_height-1;
-	while (cInfo.output_scanline < cInfo.output_height) 
+
+	while (cInfo.output_scanline < cInfo.output_height)
 	{
-		rowsRead -= jpeg_read_scanlines(&cInfo, &rowPtr[rowsRead], cInfo.output_height - rowsRead);
+		jpeg_read_scanlines(&cInfo, &rowPtr[cInfo.output_scanline], cInfo.output_height - cInfo.output_scanline);
 	}
 	delete [] rowPtr;
-	
+	rowPtr = NULL;
+
 	jpeg_finish_decompress(&cInfo);
 
 	jpeg_destroy_decompress(&cInfo);
-	
-	fclose(pFile);
-	
+
 	return pImageData;
 }
+
+int SwiftLoadJpegBatch(const char *files[], int count, int targetWidth, int targetHeight,
+	tImageJPG *images[], int nThreads, double *megapixelsPerSecond)
+{
+	std::atomic<int> next(0);
+	std::atomic<long long> pixels(0);
+	std::vector<std::thread> workers;
+
+	if (nThreads <= 0){
+		nThreads = max((int)std::thread::hardware_concurrency(), 1);
+	}
+
+	double start = SwiftSeconds();
+
+	// Each worker takes the next file until the list is exhausted
+	for (int t = 0; t < min(nThreads, count); t++){
+		workers.push_back(std::thread([&](){
+			for (int i = next++; i < count; i = next++){
+				images[i] = SwiftLoadJpegScaled(files[i], targetWidth, targetHeight);
+				if (images[i] != NULL){
+					pixels += (long long)images[i]->sizeX * images[i]->sizeY;
+				}
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++){
+		workers[t].join();
+	}
+
+	double elapsed = SwiftSeconds() - start;
+
+	int decoded = 0;
+	for (int i = 0; i < count; i++){
+		if (images[i] != NULL) decoded++;
+	}
+
+	if (megapixelsPerSecond != NULL){
+		*megapixelsPerSecond = elapsed > 0 ? (double)pixels / 1000000.0 / elapsed : 0;
+	}
+
+	return decoded;
+}
+
+void SwiftFreeJpeg(tImageJPG *pImage)
+{
+	if (pImage != NULL){
+		delete [] pImage->data;
+		free(pImage);
+	}
+}
@@ -1,6 +1,29 @@
+#pragma once
+
 #include <jpeglib.h>
 #pragma comment(lib, "jpeg.lib")
 
+typedef struct {
+	int rowSpan;
+	int sizeX, sizeY;
+	unsigned char *data;
+}tImageJPG;
+
 tImageJPG *SwiftLoadJpeg (const char *srFileName);
 
-void SwiftTextureJpeg(unsigned int tTexture[], LPSTR strFileName, int ID);
\ No newline at end of file
+// Decodes the smallest DCT scaled version (1/1, 1/2, 1/4 or 1/8) that is still at least
+// targetWidth x targetHeight. A target of 0 x 0 decodes at full resolution.
+tImageJPG *SwiftLoadJpegScaled (const char *strFileName, int targetWidth, int targetHeight);
+
+// Decodes a jpeg already in memory, scaled by 1/scaleDenom (1, 2, 4 or 8).
+tImageJPG *SwiftDecodeJpeg (const unsigned char *buffer, unsigned long size, int scaleDenom);
+
+// Decodes count files on nThreads worker threads. images[i] is NULL if files[i] failed.
+// Returns the number of images decoded; the throughput in megapixels per second is
+// written to megapixelsPerSecond when it is not NULL.
+int SwiftLoadJpegBatch (const char *files[], int count, int targetWidth, int targetHeight,
+	tImageJPG *images[], int nThreads, double *megapixelsPerSecond);
+
+void SwiftFreeJpeg (tImageJPG *pImage);
+
+void SwiftTextureJpeg(unsigned int tTexture[], LPSTR strFileName, int ID);
@@ -0,0 +1,128 @@
+#include "BatchProcessor.h"
+#include <iostream>
+#include <thread>
+#include <algorithm>
+
+BatchProcessor::BatchProcessor(const HeadlessRunner::Mode mode, const std::string &faceCascadePath)
+    : m_mode(mode), m_faceCascadePath(faceCascadePath), m_format(ResultWriter::CSV), m_workers(0),
+    m_range(ColorTracker::DEFAULT_RANGE), m_markerSize(0.045f), m_motionGate(true), m_files(NULL), m_nextFile(0), m_frames(0),
+    m_failed(0)
+{
+}
+
+void BatchProcessor::setFormat(const ResultWriter::Format format)
+{
+    m_format = format;
+}
+
+void BatchProcessor::setWorkers(const int workers)
+{
+    m_workers = workers;
+}
+
+void BatchProcessor::setOutputDirectory(const std::string &directory)
+{
+    m_outputDirectory = directory;
+}
+
+void BatchProcessor::setColorRange(const ColorRange &range)
+{
+    m_range = range;
+}
+
+void BatchProcessor::setCamera(const aruco::CameraParameters &camera, const float markerSize)
+{
+    m_camera = camera;
+    m_markerSize = markerSize;
+}
+
+void BatchProcessor::setMotionGate(const bool enabled)
+{
+    m_motionGate = enabled;
+}
+
+/*
+* Processes every file and prints, per file and in total, the frames processed and the
+* frames per second. Returns the total number of frames.
+*/
+long long BatchProcessor::run(const std::vector<std::string> &files)
+{
+    int workers = m_workers > 0 ? m_workers : (int)std::max(std::thread::hardware_concurrency(), 1u);
+    workers = std::max(std::min(workers, (int)files.size()), 1);
+
+    m_files = &files;
+    m_nextFile = 0;
+    m_frames = 0;
+    m_failed = 0;
+
+    int64 start = cv::getTickCount();
+    std::vector<std::thread> threads;
+    for (int w = 0; w < workers; w++) {
+        threads.push_back(std::thread(&BatchProcessor::workerLoop, this));
+    }
+    for (size_t w = 0; w < threads.size(); w++) {
+        threads[w].join();
+    }
+    double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+    m_files = NULL;
+
+    std::cout << "Batch " << HeadlessRunner::modeName(m_mode) << ": " << files.size() - m_failed << " of " << files.size()
+        << " files, " << m_frames << " frames in " << elapsed << " s with " << workers << " workers ("
+        << (elapsed > 0 ? m_frames / elapsed : 0.0) << " fps in total)" << std::endl;
+    return m_frames;
+}
+
+void BatchProcessor::workerLoop()
+{
+    size_t file;
+    while ((file = m_nextFile++) < m_files->size()) {
+        if (!processFile((*m_files)[file])) m_failed++;
+    }
+}
+
+bool BatchProcessor::processFile(const std::string &file)
+{
+    FrameSource source;
+    if (!source.open(file) || source.kind() == FrameSource::CAMERA) {
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        std::cout << file << ": could not be opened" << std::endl;
+        return false;
+    }
+    source.setPacing(FrameSource::UNPACED);
+
+    try {
+        HeadlessRunner runner(source, m_mode, m_faceCascadePath);
+        runner.setColorRange(m_range);
+        runner.setCamera(m_camera, m_markerSize);
+        runner.motionGate().setEnabled(m_motionGate);
+
+        ResultWriter writer;
+        std::string output = outputPath(file);
+        if (!writer.open(output, m_format, runner.resultFields())) return false;
+        runner.setResultWriter(&writer);
+
+        int64 start = cv::getTickCount();
+        long long frames = runner.run(0, NULL);
+        double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+        m_frames += frames;
+
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        std::cout << file << ": " << frames << " frames, " << (elapsed > 0 ? frames / elapsed : 0.0) << " fps -> " << output << std::endl;
+    }
+    catch (std::exception &ex) {
+        std::lock_guard<std::mutex> lock(m_outputMutex);
+        std::cout << file << ": " << ex.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::string BatchProcessor::outputPath(const std::string &file) const
+{
+    std::string name = file;
+    if (!m_outputDirectory.empty()) {
+        size_t slash = file.find_last_of("/\\");
+        name = m_outputDirectory + "/" + (slash == std::string::npos ? file : file.substr(slash + 1));
+    }
+    return name + "." + HeadlessRunner::modeName(m_mode) + ResultWriter::extension(m_format);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "HeadlessRunner.h"
+#include "ResultWriter.h"
+
+/*
+* Runs the tracker of one mode over a list of recorded videos (or image sequences) with no
+* window, several files at once: each worker thread takes the next file of the list and
+* plays it unpaced through a HeadlessRunner of its own, with its own colour pipeline, face
+* detector or marker search, so the workers share nothing but the list.
+*
+* The results of each file go to a file of their own (see ResultWriter), named after it:
+* "video.avi" gives "video.avi.color.csv", next to it or in outputDirectory.
+*/
+class BatchProcessor
+{
+public:
+    BatchProcessor(const HeadlessRunner::Mode mode, const std::string &faceCascadePath);
+
+    void            setFormat(const ResultWriter::Format format);
+    void            setWorkers(const int workers);
+    void            setOutputDirectory(const std::string &directory);
+    void            setColorRange(const ColorRange &range);
+    void            setCamera(const aruco::CameraParameters &camera, const float markerSize);
+    void            setMotionGate(const bool enabled);
+
+    long long       run(const std::vector<std::string> &files);
+
+private:
+    HeadlessRunner::Mode        m_mode;
+    std::string                 m_faceCascadePath;
+    ResultWriter::Format        m_format;
+    int                         m_workers;          // 0: one per core
+    std::string                 m_outputDirectory;
+    ColorRange                  m_range;
+    aruco::CameraParameters     m_camera;
+    float                       m_markerSize;
+    bool                        m_motionGate;
+
+    // Of the current run()
+    const std::vector<std::string>* m_files;
+    std::atomic<size_t>         m_nextFile;
+    std::atomic<long long>      m_frames;
+    std::atomic<int>            m_failed;
+    std::mutex                  m_outputMutex;      // for the lines printed by the workers
+
+    void            workerLoop();
+    bool            processFile(const std::string &file);
+    std::string     outputPath(const std::string &file) const;
+};
@@ -0,0 +1,128 @@
+#include "BlobTracker.h"
+#include <cmath>
+#include <algorithm>
+
+BlobTracker::BlobTracker(const int maxTracks)
+    : m_maxTracks(std::max(maxTracks, 1)), m_nextId(0)
+{
+    m_noise[0] = 1e5;
+    m_noise[1] = 4.0;
+    m_noise[2] = 1e4;
+    m_noise[3] = 4.0;
+}
+
+void BlobTracker::setMaxTracks(const int maxTracks)
+{
+    m_maxTracks = std::max(maxTracks, 1);
+    if ((int)m_tracks.size() > m_maxTracks) {
+        reset();
+    }
+}
+
+int BlobTracker::maxTracks() const
+{
+    return m_maxTracks;
+}
+
+void BlobTracker::setNoise(const double positionProcess, const double positionMeasurement,
+    const double radiusProcess, const double radiusMeasurement)
+{
+    m_noise[0] = positionProcess;
+    m_noise[1] = positionMeasurement;
+    m_noise[2] = radiusProcess;
+    m_noise[3] = radiusMeasurement;
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        applyNoise(m_tracks[i]);
+    }
+}
+
+void BlobTracker::applyNoise(BlobTrack &track) const
+{
+    track.x.setNoise(m_noise[0], m_noise[1]);
+    track.y.setNoise(m_noise[0], m_noise[1]);
+    track.radius.setNoise(m_noise[2], m_noise[3]);
+}
+
+void BlobTracker::reset()
+{
+    m_tracks.clear();
+}
+
+/*
+* Blobs detected in the frame captured at time (seconds).
+*/
+void BlobTracker::update(const std::vector<BlobDetection> &blobs, const double time)
+{
+    m_candidates.clear();
+    for (size_t t = 0; t < m_tracks.size(); t++) {
+        const BlobTrack &track = m_tracks[t];
+        float x = (float)track.x.predict(time), y = (float)track.y.predict(time);
+        float radius = (float)track.radius.predict(time);
+
+        for (size_t b = 0; b < blobs.size(); b++) {
+            float dx = blobs[b].center.x - x, dy = blobs[b].center.y - y;
+            float distance = std::sqrt(dx * dx + dy * dy);
+            if (distance <= 2 * std::max(radius, blobs[b].radius) + MIN_GATE) {
+                Candidate candidate = { distance, (int)t, (int)b };
+                m_candidates.push_back(candidate);
+            }
+        }
+    }
+    std::sort(m_candidates.begin(), m_candidates.end());
+
+    m_trackMatched.assign(m_tracks.size(), false);
+    m_blobMatched.assign(blobs.size(), false);
+    for (size_t i = 0; i < m_candidates.size(); i++) {
+        const Candidate &candidate = m_candidates[i];
+        if (m_trackMatched[candidate.track] || m_blobMatched[candidate.blob]) continue;
+        m_trackMatched[candidate.track] = true;
+        m_blobMatched[candidate.blob] = true;
+
+        BlobTrack &track = m_tracks[candidate.track];
+        const BlobDetection &blob = blobs[candidate.blob];
+        track.x.correct(blob.center.x, time);
+        track.y.correct(blob.center.y, time);
+        track.radius.correct(blob.radius, time);
+        track.hits++;
+        track.misses = 0;
+    }
+
+    // Missed tracks, removed in place so the matched flags still line up while counting
+    size_t kept = 0;
+    for (size_t t = 0; t < m_tracks.size(); t++) {
+        if (!m_trackMatched[t] && ++m_tracks[t].misses > MAX_MISSES) continue;
+        if (kept != t) m_tracks[kept] = m_tracks[t];
+        kept++;
+    }
+    m_tracks.resize(kept);
+
+    for (size_t b = 0; b < blobs.size() && (int)m_tracks.size() < m_maxTracks; b++) {
+        if (m_blobMatched[b]) continue;
+
+        BlobTrack track;
+        track.id = m_nextId++;
+        track.hits = 1;
+        track.misses = 0;
+        applyNoise(track);
+        track.x.correct(blobs[b].center.x, time);
+        track.y.correct(blobs[b].center.y, time);
+        track.radius.correct(blobs[b].radius, time);
+        m_tracks.push_back(track);
+    }
+}
+
+const std::vector<BlobTrack>& BlobTracker::tracks() const
+{
+    return m_tracks;
+}
+
+const BlobTrack* BlobTracker::primary() const
+{
+    const BlobTrack *best = NULL;
+    for (size_t t = 0; t < m_tracks.size(); t++) {
+        if (best == NULL || m_tracks[t].hits > best->hits) {
+            best = &m_tracks[t];
+        }
+    }
+    return best;
+}
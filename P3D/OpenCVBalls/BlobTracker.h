@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include "ColorTracker.h"
+#include "MotionFilter.h"
+
+/*
+* One object followed across frames, with its own filters.
+*/
+struct BlobTrack
+{
+    int             id;
+    MotionFilter    x, y, radius;
+    int             hits;           // frames it was detected in
+    int             misses;         // consecutive frames it was not
+};
+
+/*
+* Follows several blobs at once. The blobs of each frame are matched to the tracks by
+* nearest predicted position, closest pairs first, within a gate that grows with the
+* radius; unmatched blobs start new tracks and tracks missed for a few frames are dropped.
+*
+* primary() is the track that has been seen the most, so one ball keeps driving the camera
+* or the planet while others come and go.
+*/
+class BlobTracker
+{
+public:
+    BlobTracker(const int maxTracks = 4);
+
+    void                            setMaxTracks(const int maxTracks);
+    int                             maxTracks() const;
+    void                            setNoise(const double positionProcess, const double positionMeasurement,
+                                        const double radiusProcess, const double radiusMeasurement);
+    void                            reset();
+
+    void                            update(const std::vector<BlobDetection> &blobs, const double time);
+    const std::vector<BlobTrack>&   tracks() const;
+    const BlobTrack*                primary() const;
+
+private:
+    static const int    MAX_MISSES = 5;
+    static const int    MIN_GATE = 30;              // pixels, on top of twice the radius
+
+    struct Candidate
+    {
+        float   distance;
+        int     track, blob;
+
+        bool operator<(const Candidate &other) const { return distance < other.distance; }
+    };
+
+    std::vector<BlobTrack>  m_tracks;
+    int                     m_maxTracks;
+    int                     m_nextId;
+    double                  m_noise[4];
+
+    // Kept between frames
+    std::vector<Candidate>  m_candidates;
+    std::vector<bool>       m_trackMatched;
+    std::vector<bool>       m_blobMatched;
+
+    void    applyNoise(BlobTrack &track) const;
+};
@@ -0,0 +1,201 @@
+#include "CameraBackground.h"
+#include <iostream>
+#include <cstring>
+#include <opencv2\imgproc.hpp>
+
+CameraBackground::CameraBackground()
+{
+    m_pbos[0] = m_pbos[1] = 0;
+}
+
+CameraBackground::~CameraBackground()
+{
+    release();
+}
+
+void CameraBackground::allocate(const cv::Size &frameSize)
+{
+    release();
+
+    m_size = frameSize;
+    m_usePbo = GLEW_ARB_pixel_buffer_object != 0;
+
+    glGenTextures(1, &m_texture);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, m_size.width, m_size.height, 0, GL_BGR, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (m_usePbo) {
+        glGenBuffers(2, m_pbos);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbos[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size.area() * 3, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+void CameraBackground::release()
+{
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+        m_texture = 0;
+    }
+    if (m_pbos[0] != 0) {
+        glDeleteBuffers(2, m_pbos);
+        m_pbos[0] = m_pbos[1] = 0;
+    }
+}
+
+/*
+* Copies a CV_8UC3 BGR frame into the texture. The texture is reallocated only when
+* the frame size changes.
+*/
+void CameraBackground::upload(const cv::Mat &frame)
+{
+    if (frame.empty() || frame.type() != CV_8UC3) return;
+
+    int64 start = cv::getTickCount();
+
+    if (m_texture == 0 || frame.size() != m_size) {
+        allocate(frame.size());
+    }
+
+    const size_t rowBytes = m_size.width * 3;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+
+    if (m_usePbo) {
+        // Orphaning hands back fresh storage if the driver is still reading this buffer
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbos[m_pboIndex]);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, m_size.area() * 3, NULL, GL_STREAM_DRAW);
+        unsigned char *dst = (unsigned char *)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        if (dst != NULL) {
+            if (frame.isContinuous()) {
+                memcpy(dst, frame.data, rowBytes * m_size.height);
+            }
+            else {
+                for (int y = 0; y < m_size.height; y++)
+                    memcpy(dst + y * rowBytes, frame.ptr(y), rowBytes);
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_size.width, m_size.height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_pboIndex = 1 - m_pboIndex;
+    }
+    else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(frame.step / 3));
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_size.width, m_size.height, GL_BGR, GL_UNSIGNED_BYTE, frame.data);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_uploadTime += (cv::getTickCount() - start) / cv::getTickFrequency();
+    m_uploads++;
+}
+
+/*
+* Fills the viewport with the last uploaded frame. Row 0 of the frame goes to the
+* bottom of the window unless firstRowAtTop is set. Matrices and state are restored.
+*/
+void CameraBackground::draw(const bool mirrorHorizontal, const bool firstRowAtTop) const
+{
+    if (m_texture == 0) return;
+
+    float u0 = mirrorHorizontal ? 1.0f : 0.0f, u1 = 1.0f - u0;
+    float v0 = firstRowAtTop ? 1.0f : 0.0f, v1 = 1.0f - v0;
+
+    glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_DEPTH_BUFFER_BIT | GL_CURRENT_BIT);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    glBegin(GL_QUADS);
+    glTexCoord2f(u0, v0);
+    glVertex2f(-1.0f, -1.0f);
+    glTexCoord2f(u1, v0);
+    glVertex2f(1.0f, -1.0f);
+    glTexCoord2f(u1, v1);
+    glVertex2f(1.0f, 1.0f);
+    glTexCoord2f(u0, v1);
+    glVertex2f(-1.0f, 1.0f);
+    glEnd();
+
+    glPopMatrix();
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPopAttrib();
+}
+
+cv::Size CameraBackground::size() const
+{
+    return m_size;
+}
+
+double CameraBackground::averageUploadTime() const
+{
+    return m_uploads > 0 ? m_uploadTime / m_uploads : 0;
+}
+
+/*
+* Compares the old background path (two flips and glDrawPixels) with the texture path
+* for frames of the given size. Needs a current OpenGL context; prints ms per frame.
+*/
+void CameraBackground::benchmark(const cv::Size &frameSize, const int frames)
+{
+    cv::Mat frame(frameSize, CV_8UC3), flipped, flippedTwice;
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glRasterPos2f(-1.0f, -1.0f);
+    glFinish();
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        cv::flip(frame, flipped, 0);
+        cv::flip(flipped, flippedTwice, 1);
+        glDrawPixels(flippedTwice.cols, flippedTwice.rows, GL_BGR, GL_UNSIGNED_BYTE, flippedTwice.ptr());
+    }
+    glFinish();
+    double drawPixels = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    CameraBackground background;
+    background.upload(frame);
+    background.draw(true, true);
+    glFinish();
+
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        background.upload(frame);
+        background.draw(true, true);
+    }
+    glFinish();
+    double texture = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    std::cout << "Camera background " << frameSize.width << "x" << frameSize.height << ": glDrawPixels "
+        << drawPixels * 1000.0 << " ms, texture " << texture * 1000.0 << " ms per frame ("
+        << (background.m_usePbo ? "pixel buffer objects" : "no pixel buffer objects") << ")" << std::endl;
+}
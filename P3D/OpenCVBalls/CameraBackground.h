@@ -0,0 +1,37 @@
+#pragma once
+
+#include <opencv2\core.hpp>
+#include "Dependencies\glew\glew.h"
+
+/*
+* Draws the camera frame as a textured full screen quad.
+* Frames are streamed into a persistent texture with glTexSubImage2D, going through two
+* pixel buffer objects used alternately so that writing a frame never waits for the
+* driver to finish reading the previous one. Mirroring is done with texture coordinates,
+* so the frame is uploaded exactly as the camera delivered it.
+*/
+class CameraBackground
+{
+public:
+    CameraBackground();
+    ~CameraBackground();
+
+    void        upload(const cv::Mat &frame);
+    void        draw(const bool mirrorHorizontal, const bool firstRowAtTop) const;
+    cv::Size    size() const;
+    double      averageUploadTime() const;
+
+    static void benchmark(const cv::Size &frameSize, const int frames);
+
+private:
+    GLuint      m_texture = 0;
+    GLuint      m_pbos[2];
+    int         m_pboIndex = 0;
+    bool        m_usePbo = false;
+    cv::Size    m_size;
+    double      m_uploadTime = 0;
+    long long   m_uploads = 0;
+
+    void        allocate(const cv::Size &frameSize);
+    void        release();
+};
@@ -0,0 +1,182 @@
+#include "ColorLut.h"
+#include <cstring>
+#include <cmath>
+#include <opencv2\core.hpp>
+
+namespace
+{
+    const int TABLE_BYTES = (1 << 24) / 8;
+    const int HSV_SHIFT = 12;
+
+    bool sameRange(const ColorRange &a, const ColorRange &b)
+    {
+        return memcmp(&a, &b, sizeof(ColorRange)) == 0;
+    }
+
+    /*
+    * Fills the bits of every colour with a given blue value. Uses the same fixed point
+    * arithmetic as OpenCV's 8-bit BGR to HSV conversion, so the result is bit-exact.
+    */
+    class BuildBody : public cv::ParallelLoopBody
+    {
+    public:
+        BuildBody(const ColorRange &range, uchar *bits)
+            : m_range(range), m_bits(bits)
+        {
+            m_saturationDiv[0] = m_hueDiv[0] = 0;
+            for (int i = 1; i < 256; i++) {
+                m_saturationDiv[i] = cvRound((255 << HSV_SHIFT) / (1. * i));
+                m_hueDiv[i] = cvRound((180 << HSV_SHIFT) / (6. * i));
+            }
+        }
+
+        void operator()(const cv::Range &blues) const
+        {
+            for (int b = blues.start; b < blues.end; b++) {
+                uchar *dst = m_bits + (b << 13);
+                for (int g = 0; g < 256; g++) {
+                    for (int r = 0; r < 256; r += 8) {
+                        uchar byte = 0;
+                        for (int bit = 0; bit < 8; bit++) {
+                            if (inRange(b, g, r + bit))
+                                byte |= 1 << bit;
+                        }
+                        *dst++ = byte;
+                    }
+                }
+            }
+        }
+
+    private:
+        const ColorRange    m_range;
+        uchar*              m_bits;
+        int                 m_saturationDiv[256];
+        int                 m_hueDiv[256];
+
+        bool inRange(const int b, const int g, const int r) const
+        {
+            int v = std::max(std::max(b, g), r);
+            if (v < m_range.lowV || v > m_range.highV) return false;
+
+            int vmin = std::min(std::min(b, g), r);
+            int diff = v - vmin;
+            int s = (diff * m_saturationDiv[v] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+            if (s < m_range.lowS || s > m_range.highS) return false;
+
+            int vr = v == r ? -1 : 0;
+            int vg = v == g ? -1 : 0;
+            int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+            h = (h * m_hueDiv[diff] + (1 << (HSV_SHIFT - 1))) >> HSV_SHIFT;
+            h += h < 0 ? 180 : 0;
+
+            return h >= m_range.lowH && h <= m_range.highH;
+        }
+    };
+}
+
+ColorLut::ColorLut()
+{
+}
+
+ColorLut::~ColorLut()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeUp.notify_one();
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+/*
+* Called once per frame by the thread that uses the tables. Swaps in a table that
+* finished building and asks for a new one if the range is not the latest one built or
+* being built.
+*/
+void ColorLut::request(const ColorRange &range)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_ready >= 0) {
+        m_active = m_ready;
+        m_ready = -1;
+    }
+
+    int latest = m_building >= 0 ? m_building : m_active;
+    if (latest >= 0 && sameRange(m_ranges[latest], range)) {
+        m_requested = false;
+        return;
+    }
+
+    m_requestedRange = range;
+    m_requested = true;
+
+    if (!m_thread.joinable()) {
+        m_tables[0].resize(TABLE_BYTES);
+        m_tables[1].resize(TABLE_BYTES);
+        m_thread = std::thread(&ColorLut::builderLoop, this);
+    }
+    m_wakeUp.notify_one();
+}
+
+/*
+* The table for exactly this range, or NULL while it is still being built.
+*/
+const uchar* ColorLut::table(const ColorRange &range) const
+{
+    if (m_active < 0 || !sameRange(m_ranges[m_active], range)) return NULL;
+    return &m_tables[m_active][0];
+}
+
+double ColorLut::lastBuildTime() const
+{
+    return m_buildTime;
+}
+
+void ColorLut::build(const ColorRange &range, uchar *bits)
+{
+    cv::parallel_for_(cv::Range(0, 256), BuildBody(range, bits));
+}
+
+bool ColorLut::contains(const uchar *bits, const int b, const int g, const int r)
+{
+    int index = (b << 16) | (g << 8) | r;
+    return (bits[index >> 3] >> (index & 7)) & 1;
+}
+
+int ColorLut::spareTable() const
+{
+    for (int i = 0; i < 2; i++) {
+        if (i != m_active && i != m_ready) return i;
+    }
+    return -1;
+}
+
+void ColorLut::builderLoop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        // A finished table that was not swapped in yet still occupies the spare slot
+        m_wakeUp.wait(lock, [this]() { return m_stopping || (m_requested && m_ready < 0); });
+        if (m_stopping) break;
+
+        int target = spareTable();
+        ColorRange range = m_requestedRange;
+        m_ranges[target] = range;
+        m_building = target;
+        m_requested = false;
+        lock.unlock();
+
+        int64 start = cv::getTickCount();
+        build(range, &m_tables[target][0]);
+        double elapsed = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+        lock.lock();
+        m_buildTime = elapsed;
+        m_building = -1;
+        m_ready = target;
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "ColorTracker.h"
+
+/*
+* One bit for every 24-bit BGR colour, set when the colour's HSV value (as computed by
+* cvtColor(COLOR_BGR2HSV) on 8-bit images) is inside a ColorRange. With it, the per pixel
+* colour test becomes a single lookup and the HSV conversion of the frame is skipped.
+*
+* A table takes 2 MB and a moment to compute, so tables are built on a background thread
+* whenever the range changes. There are two of them: the one in use and the one being
+* built; the finished one is only swapped in from the thread that reads it.
+*/
+class ColorLut
+{
+public:
+    ColorLut();
+    ~ColorLut();
+
+    void            request(const ColorRange &range);
+    const uchar*    table(const ColorRange &range) const;
+    double          lastBuildTime() const;
+
+    static void     build(const ColorRange &range, uchar *bits);
+    static bool     contains(const uchar *bits, const int b, const int g, const int r);
+
+private:
+    std::vector<uchar>          m_tables[2];
+    ColorRange                  m_ranges[2];
+    int                         m_active = -1;      // table used by the reading thread
+    int                         m_ready = -1;       // finished table waiting to be swapped in
+    int                         m_building = -1;
+    bool                        m_requested = false;
+    ColorRange                  m_requestedRange;
+    double                      m_buildTime = 0;
+
+    std::thread                 m_thread;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wakeUp;
+    bool                        m_stopping = false;
+
+    int         spareTable() const;
+    void        builderLoop();
+};
@@ -0,0 +1,617 @@
+#include "ColorTracker.h"
+#include "ColorLut.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <chrono>
+#include <emmintrin.h>
+#include <opencv2\imgproc.hpp>
+
+const ColorRange ColorTracker::DEFAULT_RANGE = { 0, 179, 133, 250, 180, 255 };
+
+namespace
+{
+    // Output rows per tile. The tile and its halo are worked on in buffers of
+    // (TILE_ROWS + 2 * HALO) rows, small enough to stay in L2 for a 1080p frame
+    const int TILE_ROWS = 32;
+    // Each 5x5 pass needs 2 more rows above and below: 4 passes
+    const int HALO = 8;
+    // Buffers keep 2 columns of padding on each side; rows start 16 bytes in
+    const int ROW_OFFSET = 16;
+
+    /*
+    * Rows of an intermediate mask, indexed by image row. The padding columns hold the
+    * neutral value of the next pass, so pixels outside the image never win the min / max.
+    */
+    struct RowBuffer
+    {
+        std::vector<uchar>  data;
+        int                 stride;
+        int                 first;
+
+        void create(const int rows, const int width)
+        {
+            stride = ROW_OFFSET + ((width + 2 + 15) & ~15);
+            data.resize(rows * stride);
+        }
+
+        uchar* row(const int imageRow)
+        {
+            return &data[(imageRow - first) * stride + ROW_OFFSET];
+        }
+
+        void setPadding(const int rows, const int width, const uchar value)
+        {
+            for (int r = 0; r < rows; r++) {
+                uchar *p = &data[r * stride + ROW_OFFSET];
+                p[-2] = p[-1] = p[width] = p[width + 1] = value;
+            }
+        }
+    };
+
+    inline __m128i minMax(const __m128i a, const __m128i b, const bool dilate)
+    {
+        return dilate ? _mm_max_epu8(a, b) : _mm_min_epu8(a, b);
+    }
+
+    inline uchar minMax(const uchar a, const uchar b, const bool dilate)
+    {
+        return dilate ? std::max(a, b) : std::min(a, b);
+    }
+
+    // Min / max over the 5 pixel wide middle rows of the ellipse
+    void horizontalPass(const uchar *src, uchar *dst, const int width, const bool dilate)
+    {
+        int x = 0;
+        for (; x + 16 <= width; x += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x - 2));
+            v = minMax(v, _mm_loadu_si128((const __m128i *)(src + x - 1)), dilate);
+            v = minMax(v, _mm_loadu_si128((const __m128i *)(src + x)), dilate);
+            v = minMax(v, _mm_loadu_si128((const __m128i *)(src + x + 1)), dilate);
+            v = minMax(v, _mm_loadu_si128((const __m128i *)(src + x + 2)), dilate);
+            _mm_storeu_si128((__m128i *)(dst + x), v);
+        }
+        for (; x < width; x++) {
+            uchar v = minMax(minMax(src[x - 2], src[x - 1], dilate), minMax(src[x], src[x + 1], dilate), dilate);
+            dst[x] = minMax(v, src[x + 2], dilate);
+        }
+    }
+
+    /*
+    * One 5x5 MORPH_ELLIPSE erode (or dilate) of rows [lo, hi). The ellipse is a single
+    * pixel on its top and bottom rows and 5 pixels wide on the three middle ones.
+    */
+    void morphologyPass(RowBuffer &src, RowBuffer &horizontal, const int lo, const int hi,
+        uchar *dstBase, const size_t dstStep, const int dstFirst,
+        const int width, const int height, const bool dilate, const uchar *neutral)
+    {
+        for (int r = std::max(lo - 1, 0); r < std::min(hi + 1, height); r++) {
+            horizontalPass(src.row(r), horizontal.row(r), width, dilate);
+        }
+
+        for (int r = lo; r < hi; r++) {
+            const uchar *top = r - 2 >= 0 ? src.row(r - 2) : neutral;
+            const uchar *bottom = r + 2 < height ? src.row(r + 2) : neutral;
+            const uchar *above = r - 1 >= 0 ? horizontal.row(r - 1) : neutral;
+            const uchar *middle = horizontal.row(r);
+            const uchar *below = r + 1 < height ? horizontal.row(r + 1) : neutral;
+            uchar *dst = dstBase + (r - dstFirst) * dstStep;
+
+            int x = 0;
+            for (; x + 16 <= width; x += 16) {
+                __m128i v = minMax(_mm_loadu_si128((const __m128i *)(top + x)), _mm_loadu_si128((const __m128i *)(bottom + x)), dilate);
+                v = minMax(v, _mm_loadu_si128((const __m128i *)(above + x)), dilate);
+                v = minMax(v, _mm_loadu_si128((const __m128i *)(middle + x)), dilate);
+                v = minMax(v, _mm_loadu_si128((const __m128i *)(below + x)), dilate);
+                _mm_storeu_si128((__m128i *)(dst + x), v);
+            }
+            for (; x < width; x++) {
+                uchar v = minMax(minMax(top[x], bottom[x], dilate), minMax(above[x], below[x], dilate), dilate);
+                dst[x] = minMax(v, middle[x], dilate);
+            }
+        }
+    }
+
+    class FusedFilterBody : public cv::ParallelLoopBody
+    {
+    public:
+        // With a lookup table the source is a BGR frame, otherwise an HSV one
+        FusedFilterBody(const cv::Mat &source, cv::Mat &mask, const uchar (*tables)[256], const uchar *lut)
+            : m_source(source), m_mask(mask), m_tables(tables), m_lut(lut)
+        {
+        }
+
+        void operator()(const cv::Range &tiles) const
+        {
+            const int width = m_source.cols, height = m_source.rows;
+            const int bufferRows = TILE_ROWS + 2 * HALO;
+
+            RowBuffer a, b, horizontal;
+            a.create(bufferRows, width);
+            b.create(bufferRows, width);
+            horizontal.create(bufferRows, width);
+            std::vector<uchar> eroded(a.stride, 255), dilated(a.stride, 0);
+
+            for (int tile = tiles.start; tile < tiles.end; tile++) {
+                const int t0 = tile * TILE_ROWS, t1 = std::min(t0 + TILE_ROWS, height);
+                a.first = b.first = horizontal.first = t0 - HALO;
+
+                // Threshold the tile and its halo
+                for (int r = std::max(t0 - HALO, 0); r < std::min(t1 + HALO, height); r++) {
+                    const uchar *src = m_source.ptr<uchar>(r);
+                    uchar *dst = a.row(r);
+                    if (m_lut != NULL) {
+                        for (int x = 0; x < width; x++, src += 3) {
+                            int index = (src[0] << 16) | (src[1] << 8) | src[2];
+                            dst[x] = (uchar)-((m_lut[index >> 3] >> (index & 7)) & 1);
+                        }
+                    }
+                    else {
+                        for (int x = 0; x < width; x++, src += 3) {
+                            dst[x] = m_tables[0][src[0]] & m_tables[1][src[1]] & m_tables[2][src[2]];
+                        }
+                    }
+                }
+
+                // Opening: erode, dilate. Closing: dilate, erode. Each pass loses 2 halo rows
+                a.setPadding(bufferRows, width, 255);
+                morphologyPass(a, horizontal, std::max(t0 - 6, 0), std::min(t1 + 6, height),
+                    b.row(b.first), b.stride, b.first, width, height, false, &eroded[ROW_OFFSET]);
+                b.setPadding(bufferRows, width, 0);
+                morphologyPass(b, horizontal, std::max(t0 - 4, 0), std::min(t1 + 4, height),
+                    a.row(a.first), a.stride, a.first, width, height, true, &dilated[ROW_OFFSET]);
+                a.setPadding(bufferRows, width, 0);
+                morphologyPass(a, horizontal, std::max(t0 - 2, 0), std::min(t1 + 2, height),
+                    b.row(b.first), b.stride, b.first, width, height, true, &dilated[ROW_OFFSET]);
+                b.setPadding(bufferRows, width, 255);
+                morphologyPass(b, horizontal, t0, t1,
+                    m_mask.data, m_mask.step, 0, width, height, false, &eroded[ROW_OFFSET]);
+            }
+        }
+
+    private:
+        const cv::Mat&  m_source;
+        cv::Mat&        m_mask;
+        const uchar     (*m_tables)[256];
+        const uchar*    m_lut;
+    };
+}
+
+ColorTracker::ColorTracker()
+{
+    ColorRange range = { 0, 179, 0, 255, 0, 255 };
+    setRange(range);
+    m_kernel = cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(5, 5));
+    m_lut = new ColorLut();
+}
+
+ColorTracker::~ColorTracker()
+{
+    delete m_lut;
+}
+
+void ColorTracker::setRange(const ColorRange &range)
+{
+    m_range = range;
+
+    const int low[3] = { range.lowH, range.lowS, range.lowV };
+    const int high[3] = { range.highH, range.highS, range.highV };
+    for (int c = 0; c < 3; c++) {
+        for (int v = 0; v < 256; v++) {
+            m_channelTables[c][v] = v >= low[c] && v <= high[c] ? 255 : 0;
+        }
+    }
+}
+
+ColorRange ColorTracker::range() const
+{
+    return m_range;
+}
+
+void ColorTracker::setMinRadius(const float radius)
+{
+    m_minRadius = radius;
+}
+
+float ColorTracker::minRadius() const
+{
+    return m_minRadius;
+}
+
+void ColorTracker::setUseLut(const bool useLut)
+{
+    m_useLut = useLut;
+}
+
+bool ColorTracker::useLut() const
+{
+    return m_useLut;
+}
+
+void ColorTracker::filter(const cv::Mat &hsv, cv::Mat &mask)
+{
+    CV_Assert(hsv.type() == CV_8UC3);
+    mask.create(hsv.size(), CV_8UC1);
+
+    const int tiles = (hsv.rows + TILE_ROWS - 1) / TILE_ROWS;
+    cv::parallel_for_(cv::Range(0, tiles), FusedFilterBody(hsv, mask, m_channelTables, NULL));
+}
+
+void ColorTracker::filterBgr(const cv::Mat &bgr, cv::Mat &mask)
+{
+    CV_Assert(bgr.type() == CV_8UC3);
+
+    const uchar *lut = NULL;
+    if (m_useLut) {
+        m_lut->request(m_range);
+        lut = m_lut->table(m_range);
+    }
+
+    if (lut == NULL) {
+        cv::cvtColor(bgr, m_hsv, cv::COLOR_BGR2HSV);
+        filter(m_hsv, mask);
+        return;
+    }
+
+    mask.create(bgr.size(), CV_8UC1);
+    const int tiles = (bgr.rows + TILE_ROWS - 1) / TILE_ROWS;
+    cv::parallel_for_(cv::Range(0, tiles), FusedFilterBody(bgr, mask, m_channelTables, lut));
+}
+
+void ColorTracker::filterReference(const cv::Mat &hsv, cv::Mat &mask)
+{
+    cv::inRange(hsv, cv::Scalar(m_range.lowH, m_range.lowS, m_range.lowV),
+        cv::Scalar(m_range.highH, m_range.highS, m_range.highV), mask);
+
+    // Morphological opening removes small objects from the foreground
+    cv::erode(mask, m_morphology, m_kernel);
+    cv::dilate(m_morphology, mask, m_kernel);
+
+    // Morphological closing fills small holes in the foreground
+    cv::dilate(mask, m_morphology, m_kernel);
+    cv::erode(m_morphology, mask, m_kernel);
+}
+
+int ColorTracker::findRoot(int label)
+{
+    while (m_parents[label] != label) {
+        m_parents[label] = m_parents[m_parents[label]];
+        label = m_parents[label];
+    }
+    return label;
+}
+
+/*
+* Labels the 8-connected blobs of the mask (any non-zero pixel) and leaves the stats of
+* each one in m_blobs, at the labels listed in m_roots.
+*/
+void ColorTracker::labelBlobs(const cv::Mat &mask)
+{
+    CV_Assert(mask.type() == CV_8UC1);
+
+    m_previousRuns.clear();
+    m_parents.clear();
+    m_blobs.clear();
+
+    for (int y = 0; y < mask.rows; y++) {
+        const uchar *row = mask.ptr<uchar>(y);
+        m_currentRuns.clear();
+
+        size_t previous = 0;
+        int x = 0;
+        while (x < mask.cols) {
+            while (x < mask.cols && row[x] == 0) x++;
+            if (x == mask.cols) break;
+            int start = x;
+            while (x < mask.cols && row[x] != 0) x++;
+
+            Run run = { start, x, -1 };
+
+            // Runs of the previous row touching this one, diagonals included
+            while (previous < m_previousRuns.size() && m_previousRuns[previous].end < start) previous++;
+            for (size_t i = previous; i < m_previousRuns.size() && m_previousRuns[i].start <= x; i++) {
+                int root = findRoot(m_previousRuns[i].label);
+                if (run.label < 0) {
+                    run.label = root;
+                }
+                else if (root != run.label) {
+                    int low = std::min(root, run.label), high = std::max(root, run.label);
+                    m_parents[high] = low;
+                    run.label = low;
+                }
+            }
+            if (run.label < 0) {
+                run.label = (int)m_parents.size();
+                m_parents.push_back(run.label);
+                BlobStats empty = { 0, 0, 0, INT_MAX, INT_MIN, INT_MAX, INT_MIN };
+                m_blobs.push_back(empty);
+            }
+
+            // Stats go to the label the run was given; merged labels are added up at the end
+            BlobStats &blob = m_blobs[run.label];
+            long long length = run.end - run.start;
+            blob.area += length;
+            blob.sumX += (long long)(run.start + run.end - 1) * length / 2;
+            blob.sumY += (long long)y * length;
+            blob.minX = std::min(blob.minX, run.start);
+            blob.maxX = std::max(blob.maxX, run.end - 1);
+            blob.minY = std::min(blob.minY, y);
+            blob.maxY = std::max(blob.maxY, y);
+
+            m_currentRuns.push_back(run);
+        }
+
+        m_previousRuns.swap(m_currentRuns);
+    }
+
+    // Labels are only ever joined to smaller ones: from the highest label down, every blob
+    // has had all its pieces added by the time it is reached
+    m_roots.clear();
+    for (int label = (int)m_blobs.size() - 1; label >= 0; label--) {
+        int root = findRoot(label);
+        if (root != label) {
+            BlobStats &blob = m_blobs[label], &into = m_blobs[root];
+            into.area += blob.area;
+            into.sumX += blob.sumX;
+            into.sumY += blob.sumY;
+            into.minX = std::min(into.minX, blob.minX);
+            into.maxX = std::max(into.maxX, blob.maxX);
+            into.minY = std::min(into.minY, blob.minY);
+            into.maxY = std::max(into.maxY, blob.maxY);
+        }
+        else {
+            m_roots.push_back(label);
+        }
+    }
+}
+
+/*
+* The center is the blob's centroid and the radius half the larger side of its bounding
+* box, which for a disc is the same as the enclosing circle of detectReference().
+*/
+BlobDetection ColorTracker::toDetection(const BlobStats &blob) const
+{
+    BlobDetection detection;
+    detection.center = cv::Point2f((float)blob.sumX / blob.area, (float)blob.sumY / blob.area);
+    detection.radius = std::max(blob.maxX - blob.minX + 1, blob.maxY - blob.minY + 1) / 2.0f;
+    detection.found = (int)detection.radius > m_minRadius;
+    return detection;
+}
+
+/*
+* Largest blob of the mask.
+*/
+BlobDetection ColorTracker::detect(const cv::Mat &mask)
+{
+    labelBlobs(mask);
+
+    int largest = -1;
+    for (size_t i = 0; i < m_roots.size(); i++) {
+        if (largest < 0 || m_blobs[m_roots[i]].area > m_blobs[largest].area) {
+            largest = m_roots[i];
+        }
+    }
+    if (largest < 0) {
+        BlobDetection detection;
+        detection.found = false;
+        detection.radius = 0;
+        return detection;
+    }
+    return toDetection(m_blobs[largest]);
+}
+
+/*
+* Up to maxBlobs blobs bigger than the minimum radius, largest first, from the same pass
+* over the mask as detect().
+*/
+void ColorTracker::detectAll(const cv::Mat &mask, std::vector<BlobDetection> &blobs, const int maxBlobs)
+{
+    labelBlobs(mask);
+    blobs.clear();
+
+    std::sort(m_roots.begin(), m_roots.end(), [this](const int a, const int b) {
+        return m_blobs[a].area > m_blobs[b].area;
+    });
+    for (size_t i = 0; i < m_roots.size() && (int)blobs.size() < maxBlobs; i++) {
+        BlobDetection detection = toDetection(m_blobs[m_roots[i]]);
+        if (detection.found) blobs.push_back(detection);
+    }
+}
+
+/*
+* Largest external contour of the mask, approximated by its enclosing circle.
+* The mask is modified (findContours works in place).
+*/
+BlobDetection ColorTracker::detectReference(cv::Mat &mask) const
+{
+    BlobDetection detection;
+    detection.found = false;
+    detection.radius = 0;
+
+    std::vector<std::vector<cv::Point> > contours;
+    std::vector<cv::Vec4i> hierarchy;
+    cv::findContours(mask, contours, hierarchy, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE);
+    if (contours.empty()) return detection;
+
+    int largest = 0;
+    double largestArea = 0;
+    for (size_t i = 0; i < contours.size(); i++) {
+        double area = cv::contourArea(contours[i], false);
+        if (area > largestArea) {
+            largestArea = area;
+            largest = (int)i;
+        }
+    }
+
+    std::vector<cv::Point> polygon;
+    cv::approxPolyDP(cv::Mat(contours[largest]), polygon, 3, true);
+    cv::minEnclosingCircle(cv::Mat(polygon), detection.center, detection.radius);
+
+    detection.found = (int)detection.radius > m_minRadius;
+
+    return detection;
+}
+
+/*
+* Times filter() against filterReference() on a synthetic frame (coloured discs over
+* noise, so both the threshold and the morphology have work to do) and checks that
+* both produce the same mask. Prints ms per frame.
+*/
+void ColorTracker::benchmarkFilter(const cv::Size &frameSize, const int frames)
+{
+    cv::Mat hsv(frameSize, CV_8UC3), fused, reference;
+    cv::randu(hsv, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::RNG rng(12345);
+    for (int i = 0; i < 20; i++) {
+        cv::Point center(rng.uniform(0, frameSize.width), rng.uniform(0, frameSize.height));
+        cv::circle(hsv, center, rng.uniform(5, frameSize.height / 6), cv::Scalar(rng.uniform(0, 180), 200, 220), -1);
+    }
+
+    ColorTracker tracker;
+    ColorRange range = DEFAULT_RANGE;
+    tracker.setRange(range);
+
+    tracker.filterReference(hsv, reference);
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        tracker.filterReference(hsv, reference);
+    }
+    double referenceTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    tracker.filter(hsv, fused);
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        tracker.filter(hsv, fused);
+    }
+    double fusedTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    int differences = cv::countNonZero(fused != reference);
+
+    std::cout << "Colour filter " << frameSize.width << "x" << frameSize.height << ": OpenCV "
+        << referenceTime * 1000.0 << " ms, fused " << fusedTime * 1000.0 << " ms per frame ("
+        << cv::getNumThreads() << " threads), " << (differences == 0 ? "identical" : "DIFFERENT")
+        << " output (" << differences << " pixels differ)" << std::endl;
+}
+
+/*
+* Builds the lookup table for the default slider values, checks that the lookup path gives
+* the same mask as cvtColor + the HSV path on a synthetic frame and on every 24-bit colour,
+* and times both per frame.
+*/
+void ColorTracker::benchmarkLut(const cv::Size &frameSize, const int frames)
+{
+    cv::Mat bgr(frameSize, CV_8UC3), hsv, withLut, withHsv;
+    cv::randu(bgr, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::RNG rng(12345);
+    for (int i = 0; i < 20; i++) {
+        cv::Point center(rng.uniform(0, frameSize.width), rng.uniform(0, frameSize.height));
+        cv::circle(bgr, center, rng.uniform(5, frameSize.height / 6), cv::Scalar(40, 60, rng.uniform(180, 256)), -1);
+    }
+
+    ColorRange range = DEFAULT_RANGE;
+
+    std::vector<uchar> bits((1 << 24) / 8);
+    int64 start = cv::getTickCount();
+    ColorLut::build(range, &bits[0]);
+    double buildTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    // Every colour, against OpenCV's own conversion
+    cv::Mat allColors(4096, 4096, CV_8UC3), allHsv;
+    for (int i = 0; i < (1 << 24); i++) {
+        allColors.data[i * 3] = (uchar)(i >> 16);
+        allColors.data[i * 3 + 1] = (uchar)(i >> 8);
+        allColors.data[i * 3 + 2] = (uchar)i;
+    }
+    cv::cvtColor(allColors, allHsv, cv::COLOR_BGR2HSV);
+    int wrongColors = 0;
+    for (int i = 0; i < (1 << 24); i++) {
+        const uchar *p = &allHsv.data[i * 3];
+        bool inside = p[0] >= range.lowH && p[0] <= range.highH && p[1] >= range.lowS && p[1] <= range.highS &&
+            p[2] >= range.lowV && p[2] <= range.highV;
+        if (inside != ColorLut::contains(&bits[0], i >> 16, (i >> 8) & 255, i & 255))
+            wrongColors++;
+    }
+
+    ColorTracker tracker;
+    tracker.setRange(range);
+
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        cv::cvtColor(bgr, hsv, cv::COLOR_BGR2HSV);
+        tracker.filter(hsv, withHsv);
+    }
+    double hsvTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    // Wait for the tracker's own table before timing the lookup path
+    for (;;) {
+        tracker.m_lut->request(range);
+        if (tracker.m_lut->table(range) != NULL) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    tracker.filterBgr(bgr, withLut);
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        tracker.filterBgr(bgr, withLut);
+    }
+    double lutTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    int differences = cv::countNonZero(withLut != withHsv);
+
+    std::cout << "Colour lookup table: built in " << buildTime * 1000.0 << " ms, " << wrongColors
+        << " of 16777216 colours differ from cvtColor" << std::endl;
+    std::cout << "Colour filter " << frameSize.width << "x" << frameSize.height << ": cvtColor + HSV "
+        << hsvTime * 1000.0 << " ms, lookup table " << lutTime * 1000.0 << " ms per frame, "
+        << (differences == 0 ? "identical" : "DIFFERENT") << " output (" << differences << " pixels differ)" << std::endl;
+}
+
+/*
+* Times detect() against detectReference() on blurred masks of discs and small noise
+* blobs, the kind of mask the tracking pipeline gives it, and prints how far apart their
+* results are. Both are timed with a copy of the mask, which detectReference() needs.
+*/
+void ColorTracker::benchmarkDetect(const cv::Size &frameSize, const int frames)
+{
+    cv::RNG rng(12345);
+    std::vector<cv::Mat> masks(8);
+    for (size_t i = 0; i < masks.size(); i++) {
+        cv::Mat mask = cv::Mat::zeros(frameSize, CV_8UC1);
+        for (int j = 0; j < 30; j++) {
+            cv::Point center(rng.uniform(0, frameSize.width), rng.uniform(0, frameSize.height));
+            cv::circle(mask, center, rng.uniform(1, 6), cv::Scalar(255), -1);
+        }
+        cv::Point center(rng.uniform(0, frameSize.width), rng.uniform(0, frameSize.height));
+        cv::circle(mask, center, rng.uniform(20, frameSize.height / 5), cv::Scalar(255), -1);
+        cv::GaussianBlur(mask, masks[i], cv::Size(9, 9), 4, 4);
+    }
+
+    ColorTracker tracker;
+    cv::Mat copy;
+    std::vector<BlobDetection> single(masks.size()), reference(masks.size());
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        masks[i % masks.size()].copyTo(copy);
+        reference[i % masks.size()] = tracker.detectReference(copy);
+    }
+    double referenceTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        masks[i % masks.size()].copyTo(copy);
+        single[i % masks.size()] = tracker.detect(copy);
+    }
+    double singleTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    double centerError = 0, radiusError = 0;
+    for (size_t i = 0; i < masks.size(); i++) {
+        cv::Point2f offset = single[i].center - reference[i].center;
+        centerError = std::max(centerError, std::sqrt((double)offset.dot(offset)));
+        radiusError = std::max(radiusError, (double)std::abs(single[i].radius - reference[i].radius));
+    }
+
+    std::cout << "Blob detection " << frameSize.width << "x" << frameSize.height << ": findContours "
+        << referenceTime * 1000.0 << " ms, single pass " << singleTime * 1000.0 << " ms per frame, "
+        << "largest difference " << centerError << " px in center, " << radiusError << " px in radius" << std::endl;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+#include <opencv2\core.hpp>
+
+/*
+* HSV range of the colour being tracked, as set by the sliders in the Control window.
+*/
+struct ColorRange
+{
+    int     lowH, highH;
+    int     lowS, highS;
+    int     lowV, highV;
+};
+
+class ColorLut;
+
+struct BlobDetection
+{
+    bool        found;
+    cv::Point2f center;
+    float       radius;
+};
+
+/*
+* Finds a coloured object in a frame: thresholds the HSV image to the colour range,
+* cleans the mask with a morphological opening and closing and takes the largest blob.
+*
+* filter() does the threshold and the four 5x5 ellipse erode / dilate passes in one go,
+* tile by tile, so the intermediate masks stay in cache instead of going through memory
+* five times. Its output is identical to filterReference(), the plain OpenCV call chain.
+*
+* filterBgr() takes the camera frame directly. With the lookup table enabled the colour
+* test is a single lookup per BGR pixel and no HSV image is made; until the table for the
+* current range is ready it converts to HSV as before.
+*
+* detect() labels the blobs of the mask in a single pass over its rows (8-connected runs
+* joined with a union-find) while summing their area, centroid and bounding box, into
+* buffers kept between frames. detectAll() returns the largest few from the same pass.
+* detectReference() is the findContours based version.
+* detect() only touches its own buffers, so it can run on another thread than filter().
+*/
+class ColorTracker
+{
+public:
+    static const ColorRange DEFAULT_RANGE;     // the sliders' initial values
+
+    ColorTracker();
+    ~ColorTracker();
+    ColorTracker(const ColorTracker&) = delete;
+    ColorTracker& operator=(const ColorTracker&) = delete;
+
+    void            setRange(const ColorRange &range);
+    ColorRange      range() const;
+    void            setMinRadius(const float radius);
+    float           minRadius() const;
+    void            setUseLut(const bool useLut);
+    bool            useLut() const;
+
+    void            filter(const cv::Mat &hsv, cv::Mat &mask);
+    void            filterReference(const cv::Mat &hsv, cv::Mat &mask);
+    void            filterBgr(const cv::Mat &bgr, cv::Mat &mask);
+    BlobDetection   detect(const cv::Mat &mask);
+    void            detectAll(const cv::Mat &mask, std::vector<BlobDetection> &blobs, const int maxBlobs);
+    BlobDetection   detectReference(cv::Mat &mask) const;
+
+    static void     benchmarkFilter(const cv::Size &frameSize, const int frames);
+    static void     benchmarkLut(const cv::Size &frameSize, const int frames);
+    static void     benchmarkDetect(const cv::Size &frameSize, const int frames);
+
+private:
+    ColorRange      m_range;
+    unsigned char   m_channelTables[3][256];    // 255 where the channel value is inside the range
+    float           m_minRadius = 15.0f;
+    cv::Mat         m_kernel;
+    cv::Mat         m_morphology;
+    cv::Mat         m_hsv;
+    bool            m_useLut = true;
+    ColorLut*       m_lut;
+
+    // Horizontal run of mask pixels in a row, and the blob label it was given
+    struct Run
+    {
+        int     start, end;
+        int     label;
+    };
+
+    struct BlobStats
+    {
+        long long   area;
+        long long   sumX, sumY;
+        int         minX, maxX, minY, maxY;
+    };
+
+    std::vector<Run>        m_previousRuns;
+    std::vector<Run>        m_currentRuns;
+    std::vector<int>        m_parents;          // union-find of the labels
+    std::vector<BlobStats>  m_blobs;
+    std::vector<int>        m_roots;            // labels of whole blobs, after labelBlobs()
+
+    int             findRoot(int label);
+    void            labelBlobs(const cv::Mat &mask);
+    BlobDetection   toDetection(const BlobStats &blob) const;
+};
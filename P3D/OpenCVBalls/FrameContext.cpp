@@ -0,0 +1,69 @@
+#include "FrameContext.h"
+#include <opencv2\imgproc.hpp>
+
+FrameContext::FrameContext()
+    : m_hasGray(false), m_levels(0)
+{
+}
+
+/*
+* image is the BGR (or already grey) camera frame; it is not copied.
+*/
+void FrameContext::reset(const cv::Mat &image)
+{
+    m_image = image;
+    m_hasGray = false;
+    m_levels = 0;
+}
+
+const cv::Mat& FrameContext::image() const
+{
+    return m_image;
+}
+
+cv::Size FrameContext::size() const
+{
+    return m_image.size();
+}
+
+const cv::Mat& FrameContext::gray()
+{
+    if (!m_hasGray) {
+        if (m_image.channels() == 1)
+            m_gray = m_image;
+        else
+            cv::cvtColor(m_image, m_gray, cv::COLOR_BGR2GRAY);
+        m_hasGray = true;
+    }
+    return m_gray;
+}
+
+/*
+* Grey image halved level times with pyrDown: pixel (x, y) of a level is centred on pixel
+* (2x, 2y) of the level below. Builds the missing levels up to the one asked for.
+*/
+const cv::Mat& FrameContext::pyramid(const int level)
+{
+    if (level <= 0) return gray();
+
+    if ((int)m_pyramid.size() < level) m_pyramid.resize(level);
+    while (m_levels < level) {
+        const cv::Mat &below = m_levels == 0 ? gray() : m_pyramid[m_levels - 1];
+        cv::pyrDown(below, m_pyramid[m_levels]);
+        m_levels++;
+    }
+    return m_pyramid[level - 1];
+}
+
+/*
+* Deepest level that is still at least width pixels wide.
+*/
+int FrameContext::levelFor(const int width) const
+{
+    int level = 0, levelWidth = m_image.cols;
+    while ((levelWidth + 1) / 2 >= width) {
+        levelWidth = (levelWidth + 1) / 2;
+        level++;
+    }
+    return level;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <opencv2\core.hpp>
+
+/*
+* The images derived from one camera frame: its grey version and a Gaussian pyramid of it.
+* Each is built the first time a detector asks for it and then handed, as is, to every
+* other detector that needs it during the same frame, so none is computed twice.
+*
+* reset() starts a new frame and keeps the buffers, so nothing is reallocated while the
+* frame size stays the same. The images are overwritten by the next frame: a detector that
+* needs one afterwards (e.g. the previous frame for optical flow) must copy it.
+*/
+class FrameContext
+{
+public:
+    FrameContext();
+
+    void            reset(const cv::Mat &image);
+    const cv::Mat&  image() const;
+    cv::Size        size() const;
+    const cv::Mat&  gray();
+    const cv::Mat&  pyramid(const int level);
+    int             levelFor(const int width) const;
+
+private:
+    cv::Mat                 m_image;
+    cv::Mat                 m_gray;
+    bool                    m_hasGray;
+    std::vector<cv::Mat>    m_pyramid;      // level 1 onwards; level 0 is the grey image
+    int                     m_levels;       // levels built for this frame
+};
@@ -0,0 +1,104 @@
+#include "FrameGrabber.h"
+#include <iostream>
+#include <chrono>
+
+FrameGrabber::FrameGrabber(FrameSource &source)
+    : m_source(&source), m_readySlot(1), m_running(false), m_captured(0)
+{
+    for (int i = 0; i < 3; i++) {
+        m_slots[i].captureTicks = 0;
+        m_slots[i].sequence = 0;
+    }
+}
+
+FrameGrabber::~FrameGrabber()
+{
+    stop();
+}
+
+bool FrameGrabber::start()
+{
+    if (m_running) return true;
+
+    if (!m_source->isOpened()) {
+        std::cerr << "Error starting the capture thread, the camera is not open." << std::endl;
+        return false;
+    }
+
+    // Allocate every slot up front so the capture loop only ever copies pixels
+    int width = m_source->frameSize().width;
+    int height = m_source->frameSize().height;
+    if (width > 0 && height > 0) {
+        for (int i = 0; i < 3; i++) {
+            m_slots[i].image.create(height, width, CV_8UC3);
+        }
+    }
+
+    m_running = true;
+    m_thread = std::thread(&FrameGrabber::captureLoop, this);
+
+    return true;
+}
+
+void FrameGrabber::stop()
+{
+    if (!m_running) return;
+
+    m_running = false;
+    m_thread.join();
+}
+
+bool FrameGrabber::isRunning() const
+{
+    return m_running;
+}
+
+/*
+* Takes the newest complete frame, if one arrived since the last call.
+* Returns false when there is nothing new; frame() then keeps returning the previous one.
+*/
+bool FrameGrabber::update()
+{
+    if ((m_readySlot.load() & FRESH) == 0) return false;
+
+    m_readSlot = m_readySlot.exchange(m_readSlot) & ~FRESH;
+    m_taken++;
+
+    return true;
+}
+
+const CapturedFrame& FrameGrabber::frame() const
+{
+    return m_slots[m_readSlot];
+}
+
+long long FrameGrabber::framesCaptured() const
+{
+    return m_captured;
+}
+
+/*
+* Frames that were replaced by a newer one before the render thread got to them.
+*/
+long long FrameGrabber::framesSkipped() const
+{
+    return m_captured - m_taken;
+}
+
+void FrameGrabber::captureLoop()
+{
+    while (m_running) {
+        CapturedFrame &slot = m_slots[m_writeSlot];
+
+        // Also the end of a file that does not loop: the last frame stays on screen
+        if (!m_source->read(slot.image) || slot.image.empty()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        slot.captureTicks = cv::getTickCount();
+        slot.sequence = ++m_captured;
+
+        // Publish this slot and carry on writing into the one it replaces
+        m_writeSlot = m_readySlot.exchange(m_writeSlot | FRESH) & ~FRESH;
+    }
+}
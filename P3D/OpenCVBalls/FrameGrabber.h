@@ -0,0 +1,50 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <opencv2\core.hpp>
+#include "FrameSource.h"
+
+struct CapturedFrame
+{
+    cv::Mat     image;
+    int64       captureTicks;   // cv::getTickCount() right after the camera returned the frame
+    long long   sequence;       // 1 for the first frame captured, 0 if nothing was captured yet
+};
+
+/*
+* Reads the camera (or a file, see FrameSource) on its own thread so a slow camera never
+* holds up rendering.
+* Frames go into a triple buffer: the capture thread always has a slot to write into,
+* the render thread owns the slot it is using, and the third slot holds the newest
+* complete frame. The two sides only exchange slot indices with an atomic swap.
+*/
+class FrameGrabber
+{
+public:
+    FrameGrabber(FrameSource &source);
+    ~FrameGrabber();
+
+    bool                    start();
+    void                    stop();
+    bool                    isRunning() const;
+    bool                    update();
+    const CapturedFrame&    frame() const;
+    long long               framesCaptured() const;
+    long long               framesSkipped() const;
+
+private:
+    static const int        FRESH = 4;
+
+    FrameSource*            m_source;
+    CapturedFrame           m_slots[3];
+    int                     m_writeSlot = 0;
+    std::atomic<int>        m_readySlot;
+    int                     m_readSlot = 2;
+    std::thread             m_thread;
+    std::atomic<bool>       m_running;
+    std::atomic<long long>  m_captured;
+    long long               m_taken = 0;
+
+    void        captureLoop();
+};
@@ -0,0 +1,273 @@
+#include "FrameSource.h"
+#include <iostream>
+#include <fstream>
+#include <thread>
+#include <chrono>
+
+const double FrameSource::DEFAULT_FPS = 30.0;
+
+namespace
+{
+    bool fileExists(const std::string &path)
+    {
+        std::ifstream file(path.c_str());
+        return file.good();
+    }
+}
+
+FrameSource::FrameSource()
+    : m_kind(NONE), m_firstIndex(0), m_frameCount(-1), m_fps(DEFAULT_FPS), m_pacing(NATIVE), m_fixedFps(DEFAULT_FPS),
+    m_loop(false), m_position(0), m_played(0), m_pacedFrames(0), m_pacingStart(0), m_timestamp(0)
+{
+}
+
+/*
+* A camera index ("0"), an image sequence pattern (with a '%') or a video file.
+*/
+bool FrameSource::open(const std::string &path)
+{
+    if (!path.empty() && path.find_first_not_of("0123456789") == std::string::npos)
+        return openCamera(std::stoi(path));
+    if (path.find('%') != std::string::npos)
+        return openSequence(path);
+    return openVideo(path);
+}
+
+bool FrameSource::openCamera(const int index)
+{
+    close();
+    if (!m_capture.open(index)) return false;
+
+    m_kind = CAMERA;
+    m_fps = m_capture.get(CV_CAP_PROP_FPS) > 0 ? m_capture.get(CV_CAP_PROP_FPS) : DEFAULT_FPS;
+    m_frameSize = cv::Size((int)m_capture.get(CV_CAP_PROP_FRAME_WIDTH), (int)m_capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+    return true;
+}
+
+bool FrameSource::openVideo(const std::string &path)
+{
+    close();
+    if (!m_capture.open(path)) {
+        std::cerr << "Error opening the video file " << path << "." << std::endl;
+        return false;
+    }
+
+    m_kind = VIDEO_FILE;
+    m_path = path;
+    m_fps = m_capture.get(CV_CAP_PROP_FPS) > 0 ? m_capture.get(CV_CAP_PROP_FPS) : DEFAULT_FPS;
+    m_frameCount = m_capture.get(CV_CAP_PROP_FRAME_COUNT) > 0 ? (long long)m_capture.get(CV_CAP_PROP_FRAME_COUNT) : -1;
+    m_frameSize = cv::Size((int)m_capture.get(CV_CAP_PROP_FRAME_WIDTH), (int)m_capture.get(CV_CAP_PROP_FRAME_HEIGHT));
+    return true;
+}
+
+bool FrameSource::openSequence(const std::string &pattern)
+{
+    close();
+    m_path = pattern;
+
+    // Numbered from 0 or from 1; the first gap is the end
+    m_firstIndex = fileExists(cv::format(pattern.c_str(), 0)) ? 0 : 1;
+    long long count = 0;
+    while (fileExists(sequencePath(count))) {
+        count++;
+    }
+
+    cv::Mat first = cv::imread(sequencePath(0));
+    if (count == 0 || first.empty()) {
+        std::cerr << "Error opening the image sequence " << pattern << "." << std::endl;
+        return false;
+    }
+
+    m_kind = IMAGE_SEQUENCE;
+    m_frameCount = count;
+    m_fps = DEFAULT_FPS;
+    m_frameSize = first.size();
+    return true;
+}
+
+void FrameSource::close()
+{
+    m_capture.release();
+    m_kind = NONE;
+    m_path.clear();
+    m_frameCount = -1;
+    m_fps = DEFAULT_FPS;
+    m_frameSize = cv::Size();
+    m_position = m_played = m_pacedFrames = 0;
+    m_timestamp = 0;
+}
+
+bool FrameSource::isOpened() const
+{
+    return m_kind != NONE;
+}
+
+FrameSource::Kind FrameSource::kind() const
+{
+    return m_kind;
+}
+
+/*
+* The capture of a camera or video file, for code that reads it directly.
+*/
+cv::VideoCapture& FrameSource::capture()
+{
+    return m_capture;
+}
+
+/*
+* fps is only used by FIXED. A camera is never paced: it gives frames at its own rate.
+*/
+void FrameSource::setPacing(const Pacing pacing, const double fps)
+{
+    m_pacing = pacing;
+    if (fps > 0) m_fixedFps = fps;
+    m_pacedFrames = 0;
+}
+
+FrameSource::Pacing FrameSource::pacing() const
+{
+    return m_pacing;
+}
+
+void FrameSource::setLoop(const bool loop)
+{
+    m_loop = loop;
+}
+
+bool FrameSource::loop() const
+{
+    return m_loop;
+}
+
+/*
+* Next frame, or false at the end of a file that does not loop (or if the camera fails).
+*/
+bool FrameSource::read(cv::Mat &frame)
+{
+    if (m_kind == NONE) return false;
+
+    if (m_kind == CAMERA) {
+        if (!m_capture.read(frame) || frame.empty()) return false;
+        m_timestamp = cv::getTickCount() / cv::getTickFrequency();
+        m_position++;
+        return true;
+    }
+
+    if (!readFile(frame)) {
+        // Looping goes on at the same pace, unlike a seek
+        long long pacedFrames = m_pacedFrames;
+        if (!m_loop || !seek(0) || !readFile(frame)) return false;
+        m_pacedFrames = pacedFrames;
+    }
+
+    m_timestamp = m_played / rate();
+    m_played++;
+    waitUntilDue();
+    return true;
+}
+
+bool FrameSource::readFile(cv::Mat &frame)
+{
+    if (m_kind == IMAGE_SEQUENCE) {
+        if (m_position >= m_frameCount) return false;
+        frame = cv::imread(sequencePath(m_position));
+    }
+    else if (!m_capture.read(frame)) {
+        return false;
+    }
+    if (frame.empty()) return false;
+
+    m_position++;
+    return true;
+}
+
+/*
+* Moves to frame (0 is the first one) of a file. The pacing clock starts again.
+*/
+bool FrameSource::seek(const long long frame)
+{
+    if (m_kind != VIDEO_FILE && m_kind != IMAGE_SEQUENCE) return false;
+    if (frame < 0 || (m_kind == IMAGE_SEQUENCE && frame >= m_frameCount)) return false;
+
+    m_pacedFrames = 0;
+    if (m_kind == IMAGE_SEQUENCE) {
+        m_position = frame;
+        return true;
+    }
+
+    // Reopened and read forward from the start, so the frame does not depend on the codec
+    if (frame < m_position && !rewindVideo()) return false;
+    while (m_position < frame) {
+        if (!m_capture.grab()) return false;
+        m_position++;
+    }
+    return true;
+}
+
+bool FrameSource::rewindVideo()
+{
+    m_capture.release();
+    if (!m_capture.open(m_path)) return false;
+    m_position = 0;
+    return true;
+}
+
+long long FrameSource::position() const
+{
+    return m_position;
+}
+
+long long FrameSource::frameCount() const
+{
+    return m_frameCount;
+}
+
+/*
+* Frame rate of the camera or file.
+*/
+double FrameSource::fps() const
+{
+    return m_fps;
+}
+
+/*
+* Frame rate frames are played at: the fixed one when pacing is FIXED, the source's own
+* otherwise (also used for the timestamps of unpaced files).
+*/
+double FrameSource::rate() const
+{
+    return m_pacing == FIXED ? m_fixedFps : m_fps;
+}
+
+cv::Size FrameSource::frameSize() const
+{
+    return m_frameSize;
+}
+
+/*
+* Seconds of the last frame read: simulated for files, the clock for a camera.
+*/
+double FrameSource::timestamp() const
+{
+    return m_timestamp;
+}
+
+void FrameSource::waitUntilDue()
+{
+    if (m_pacing == UNPACED) return;
+
+    if (m_pacedFrames == 0) m_pacingStart = cv::getTickCount();
+    int64 due = m_pacingStart + (int64)(m_pacedFrames * cv::getTickFrequency() / rate());
+    m_pacedFrames++;
+
+    int64 now = cv::getTickCount();
+    if (due > now) {
+        std::this_thread::sleep_for(std::chrono::microseconds((long long)((due - now) * 1e6 / cv::getTickFrequency())));
+    }
+}
+
+std::string FrameSource::sequencePath(const long long frame) const
+{
+    return cv::format(m_path.c_str(), (int)(m_firstIndex + frame));
+}
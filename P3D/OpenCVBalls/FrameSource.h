@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <opencv2\core.hpp>
+#include <opencv2\highgui\highgui.hpp>
+
+/*
+* Where the frames come from: a camera, a video file, or an image sequence given as a
+* printf pattern ("frames/img_%04d.png", numbered from 0 or 1).
+*
+* Files can be played at their own frame rate (NATIVE), at a fixed simulated rate (FIXED),
+* or as fast as they can be read (UNPACED); read() sleeps until each frame is due. With
+* loop on, the end of the file goes back to its first frame.
+*
+* Files are replayed deterministically: seek() and looping never rely on the codec's own
+* seeking (which lands on key frames in many formats); a video is reopened and read
+* forward to the frame asked for, so frame n is always the same image. Their timestamps
+* are simulated too, frames read so far / rate, so a replay gives the trackers the same
+* times every run regardless of how fast it runs.
+*/
+class FrameSource
+{
+public:
+    enum Kind
+    {
+        NONE,
+        CAMERA,
+        VIDEO_FILE,
+        IMAGE_SEQUENCE
+    };
+
+    enum Pacing
+    {
+        NATIVE,
+        FIXED,
+        UNPACED
+    };
+
+    FrameSource();
+
+    bool                open(const std::string &path);
+    bool                openCamera(const int index);
+    bool                openVideo(const std::string &path);
+    bool                openSequence(const std::string &pattern);
+    void                close();
+    bool                isOpened() const;
+    Kind                kind() const;
+    cv::VideoCapture&   capture();
+
+    void                setPacing(const Pacing pacing, const double fps = 0);
+    Pacing              pacing() const;
+    void                setLoop(const bool loop);
+    bool                loop() const;
+
+    bool                read(cv::Mat &frame);
+    bool                seek(const long long frame);
+    long long           position() const;
+    long long           frameCount() const;
+    double              fps() const;
+    double              rate() const;
+    cv::Size            frameSize() const;
+    double              timestamp() const;
+
+private:
+    // Frame rate assumed when a file does not give one
+    static const double DEFAULT_FPS;
+
+    Kind                m_kind;
+    cv::VideoCapture    m_capture;
+    std::string         m_path;
+    int                 m_firstIndex;       // of the image sequence
+    long long           m_frameCount;       // -1 when unknown
+    double              m_fps;
+    cv::Size            m_frameSize;
+
+    Pacing              m_pacing;
+    double              m_fixedFps;
+    bool                m_loop;
+    long long           m_position;         // frame the next read() returns
+    long long           m_played;           // frames read since the file was opened
+    long long           m_pacedFrames;      // frames read since the pacing clock started
+    int64               m_pacingStart;
+    double              m_timestamp;
+
+    bool                readFile(cv::Mat &frame);
+    bool                rewindVideo();
+    void                waitUntilDue();
+    std::string         sequencePath(const long long frame) const;
+};
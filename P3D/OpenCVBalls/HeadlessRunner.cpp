@@ -0,0 +1,294 @@
+#include "HeadlessRunner.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <opencv2\imgproc.hpp>
+
+namespace
+{
+    const char *MODE_NAMES[] = { "color", "face", "marker" };
+
+    double secondsSince(const int64 start)
+    {
+        return (cv::getTickCount() - start) / cv::getTickFrequency();
+    }
+}
+
+HeadlessRunner::HeadlessRunner(FrameSource &source, const Mode mode, const std::string &faceCascadePath)
+    : m_source(&source), m_mode(mode), m_objects(0), m_writer(NULL), m_totalSum(0), m_totalWorst(0), m_elapsed(0), m_frames(0),
+    m_detected(0), m_range(ColorTracker::DEFAULT_RANGE), m_faceDetector(faceCascadePath, source.capture()), m_markerSize(0.045f)
+{
+    m_stageNames.push_back("read");
+    switch (m_mode) {
+    case COLOR:
+        m_stageNames.push_back("filter");
+        m_stageNames.push_back("mog+blur");
+        m_stageNames.push_back("contours");
+        m_stageNames.push_back("tracker");
+        // As in mode 1 (positional tracking)
+        m_ballTracker.setNoise(1e5, 25.0, 1e4, 16.0);
+        m_pipeline.setMaxBlobs(m_ballTracker.maxTracks());
+        break;
+    case FACE:
+        m_stageNames.push_back("tracking");
+        m_stageNames.push_back("cascade");
+        m_faceDetector.setAsync(false);
+        break;
+    default:
+        m_stageNames.push_back("flip");
+        m_stageNames.push_back("markers+pose");
+        break;
+    }
+    m_stageTimes.resize(m_stageNames.size());
+}
+
+bool HeadlessRunner::parseMode(const std::string &name, Mode &mode)
+{
+    for (int i = 0; i < MODES; i++) {
+        if (name == MODE_NAMES[i]) {
+            mode = (Mode)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* HeadlessRunner::modeName(const Mode mode)
+{
+    return mode >= 0 && mode < MODES ? MODE_NAMES[mode] : "";
+}
+
+void HeadlessRunner::setColorRange(const ColorRange &range)
+{
+    m_range = range;
+}
+
+void HeadlessRunner::setCamera(const aruco::CameraParameters &camera, const float markerSize)
+{
+    m_camera = camera;
+    m_markerSize = markerSize;
+}
+
+MotionGate& HeadlessRunner::motionGate()
+{
+    return m_motionGate;
+}
+
+/*
+* Whether the marker search is split across the cores by ParallelMarkerDetector (off by
+* default, as in the application).
+*/
+void HeadlessRunner::setMarkerParallel(const bool parallel)
+{
+    m_markerUndistortion.search().setParallel(parallel);
+}
+
+/*
+* The writer must already be open, with the fields of resultFields().
+*/
+void HeadlessRunner::setResultWriter(ResultWriter *writer)
+{
+    m_writer = writer;
+}
+
+std::vector<std::string> HeadlessRunner::resultFields() const
+{
+    const char *color[] = { "x", "y", "radius" };
+    const char *face[] = { "x", "y", "width", "height" };
+    const char *marker[] = { "rx", "ry", "rz", "tx", "ty", "tz" };
+    switch (m_mode) {
+    case COLOR:
+        return std::vector<std::string>(color, color + 3);
+    case FACE:
+        return std::vector<std::string>(face, face + 4);
+    default:
+        return std::vector<std::string>(marker, marker + 6);
+    }
+}
+
+/*
+* Processes up to maxFrames frames (all of them if maxFrames <= 0, endless for a camera or
+* a looping file), writing the stage times of each one to frameLog as CSV if it is given.
+* Returns the frames processed.
+*/
+long long HeadlessRunner::run(const long long maxFrames, std::ostream *frameLog)
+{
+    if (frameLog != NULL) {
+        *frameLog << "frame,timestamp";
+        for (size_t s = 0; s < m_stageNames.size(); s++) {
+            *frameLog << "," << m_stageNames[s] << "_ms";
+        }
+        *frameLog << ",total_ms,detected,objects" << std::endl;
+    }
+
+    m_stageSums.assign(m_stageNames.size(), 0.0);
+    m_stageWorst.assign(m_stageNames.size(), 0.0);
+    m_totalSum = m_totalWorst = 0;
+    m_frames = m_detected = 0;
+    int64 start = cv::getTickCount();
+
+    while (maxFrames <= 0 || m_frames < maxFrames) {
+        long long index = m_source->position();
+        std::fill(m_stageTimes.begin(), m_stageTimes.end(), 0.0);
+
+        int64 readStart = cv::getTickCount();
+        if (!m_source->read(m_frame)) break;
+        m_stageTimes[0] = secondsSince(readStart);
+
+        bool ran = processFrame();
+        m_detected += ran ? 1 : 0;
+
+        double total = 0;
+        for (size_t s = 0; s < m_stageTimes.size(); s++) {
+            total += m_stageTimes[s];
+            m_stageSums[s] += m_stageTimes[s];
+            m_stageWorst[s] = std::max(m_stageWorst[s], m_stageTimes[s]);
+        }
+        m_totalSum += total;
+        m_totalWorst = std::max(m_totalWorst, total);
+        m_frames++;
+
+        if (m_writer != NULL) writeResults(index);
+        if (frameLog != NULL) {
+            *frameLog << index << "," << m_source->timestamp();
+            for (size_t s = 0; s < m_stageTimes.size(); s++) {
+                *frameLog << "," << m_stageTimes[s] * 1000.0;
+            }
+            *frameLog << "," << total * 1000.0 << "," << (ran ? 1 : 0) << "," << m_objects << "\n";
+        }
+    }
+    m_elapsed = secondsSince(start);
+    return m_frames;
+}
+
+/*
+* Frames per second of the last run(), and the mean and worst time of each stage.
+*/
+void HeadlessRunner::printSummary(std::ostream &out) const
+{
+    out << "Headless " << modeName(m_mode) << ": " << m_frames << " frames in " << m_elapsed << " s ("
+        << (m_elapsed > 0 ? m_frames / m_elapsed : 0.0) << " fps), detector ran on " << m_detected << std::endl;
+    for (size_t s = 0; s < m_stageNames.size() && s < m_stageSums.size(); s++) {
+        out << "  " << std::left << std::setw(14) << m_stageNames[s] << std::right << (m_frames > 0 ? m_stageSums[s] / m_frames * 1000.0 : 0.0)
+            << " ms mean, " << m_stageWorst[s] * 1000.0 << " ms worst" << std::endl;
+    }
+    out << "  " << std::left << std::setw(14) << "total" << std::right << (m_frames > 0 ? m_totalSum / m_frames * 1000.0 : 0.0)
+        << " ms mean, " << m_totalWorst * 1000.0 << " ms worst" << std::endl;
+}
+
+/*
+* The mode's detection on m_frame, unless the motion gate skips it (the objects of the last
+* detection then stand). Returns whether it ran.
+*/
+bool HeadlessRunner::processFrame()
+{
+    if (m_mode == MARKER) {
+        int64 start = cv::getTickCount();
+        // Markers are searched in the frame turned 180 degrees, as in mode 4
+        cv::flip(m_frame, m_flipped, -1);
+        m_context.reset(m_flipped);
+        m_stageTimes[1] = secondsSince(start);
+    }
+    else {
+        m_context.reset(m_frame);
+    }
+
+    bool run = m_motionGate.update(m_context);
+    if (!run) return false;
+
+    switch (m_mode) {
+    case COLOR:
+        processColor();
+        break;
+    case FACE:
+        processFace();
+        break;
+    default:
+        processMarkers();
+        break;
+    }
+    return true;
+}
+
+void HeadlessRunner::processColor()
+{
+    // The stages run here, one frame at a time: the search window then sees every result in order
+    PipelineFrame *result = m_pipeline.process(m_frame, cv::getTickCount(), m_range);
+    if (result == NULL) return;
+    StageTimings timings = m_pipeline.timings();
+    m_stageTimes[1] = timings.threshold;
+    m_stageTimes[2] = timings.background;
+    m_stageTimes[3] = timings.contours;
+
+    int64 start = cv::getTickCount();
+    m_ballTracker.update(result->blobs, m_source->timestamp());
+    m_stageTimes[4] = secondsSince(start);
+    m_objects = (int)m_ballTracker.tracks().size();
+    m_pipeline.release(result);
+}
+
+void HeadlessRunner::processFace()
+{
+    // The detector's timeouts count the frame's timestamp, not the time the replay takes
+    m_faceDetector.detect(m_context, m_source->timestamp());
+    FaceTimings timings = m_faceDetector.timings();
+    double cascade = timings.cascade * timings.cascadePasses;
+    m_stageTimes[1] = std::max(timings.tracking - cascade, 0.0);
+    m_stageTimes[2] = cascade;
+    m_objects = (int)m_faceDetector.faces().size();
+}
+
+void HeadlessRunner::processMarkers()
+{
+    int64 start = cv::getTickCount();
+    if (m_camera.isValid()) m_camera.resize(m_flipped.size());
+    m_markerUndistortion.detect(m_markerDetector, m_context, m_camera, m_markerSize, m_markers, m_background);
+    m_stageTimes[2] = secondsSince(start);
+    m_objects = (int)m_markers.size();
+}
+
+void HeadlessRunner::writeResults(const long long frame)
+{
+    const double timestamp = m_source->timestamp();
+    m_results.clear();
+
+    if (m_mode == COLOR) {
+        for (const BlobTrack &track : m_ballTracker.tracks()) {
+            ResultObject object;
+            object.id = track.id;
+            object.values[0] = (float)track.x.predict(timestamp);
+            object.values[1] = (float)track.y.predict(timestamp);
+            object.values[2] = (float)track.radius.predict(timestamp);
+            m_results.push_back(object);
+        }
+    }
+    else if (m_mode == FACE) {
+        std::vector<TrackedFace> faces = m_faceDetector.faces();
+        for (size_t i = 0; i < faces.size(); i++) {
+            ResultObject object;
+            object.id = faces[i].id;
+            object.values[0] = (float)faces[i].face.x;
+            object.values[1] = (float)faces[i].face.y;
+            object.values[2] = (float)faces[i].face.width;
+            object.values[3] = (float)faces[i].face.height;
+            m_results.push_back(object);
+        }
+    }
+    else {
+        for (size_t i = 0; i < m_markers.size(); i++) {
+            const aruco::Marker &marker = m_markers[i];
+            if (marker.Rvec.total() < 3 || marker.Tvec.total() < 3) continue;
+            marker.Rvec.convertTo(m_rvec, CV_32F);
+            marker.Tvec.convertTo(m_tvec, CV_32F);
+            ResultObject object;
+            object.id = marker.id;
+            for (int k = 0; k < 3; k++) {
+                object.values[k] = m_rvec.ptr<float>()[k];
+                object.values[3 + k] = m_tvec.ptr<float>()[k];
+            }
+            m_results.push_back(object);
+        }
+    }
+
+    m_writer->write(frame, timestamp, m_results);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <opencv2\core.hpp>
+#include "Dependencies\aruco\aruco.h"
+#include "FrameSource.h"
+#include "FrameContext.h"
+#include "MotionGate.h"
+#include "TrackingPipeline.h"
+#include "BlobTracker.h"
+#include "VideoFaceDetector.h"
+#include "MarkerUndistortion.h"
+#include "ResultWriter.h"
+
+/*
+* Runs the computer vision of one mode over a FrameSource with no window: the colour
+* pipeline and ball tracker of modes 1 and 2, the face detector of mode 3 or the marker
+* search and poses of mode 4, set up as the application sets them up, and times each
+* stage of every frame.
+*
+* Every frame is processed, one at a time, so a replay of the same file gives the same
+* results on every run: the stages of the colour pipeline run on the runner's thread, one
+* frame after the other, and the face cascade runs synchronously instead of on its own
+* thread, with its timeouts counted in the timestamps of the frames.
+*
+* With a ResultWriter, the objects of every frame are written out too: the filtered centre
+* and radius of each ball, the rectangle of each face, or the pose (Rvec, Tvec) of each
+* marker. A frame the motion gate skipped repeats the objects of the last detection.
+*/
+class HeadlessRunner
+{
+public:
+    enum Mode
+    {
+        COLOR,
+        FACE,
+        MARKER,
+        MODES
+    };
+
+    HeadlessRunner(FrameSource &source, const Mode mode, const std::string &faceCascadePath);
+
+    static bool         parseMode(const std::string &name, Mode &mode);
+    static const char*  modeName(const Mode mode);
+
+    void                setColorRange(const ColorRange &range);
+    void                setCamera(const aruco::CameraParameters &camera, const float markerSize);
+    MotionGate&         motionGate();
+    void                setMarkerParallel(const bool parallel);
+    void                setResultWriter(ResultWriter *writer);
+    std::vector<std::string>    resultFields() const;
+
+    long long           run(const long long maxFrames, std::ostream *frameLog);
+    void                printSummary(std::ostream &out) const;
+
+private:
+    FrameSource*                m_source;
+    Mode                        m_mode;
+    cv::Mat                     m_frame;
+    FrameContext                m_context;
+    MotionGate                  m_motionGate;
+    std::vector<std::string>    m_stageNames;   // read first; the rest depend on the mode
+    std::vector<double>         m_stageTimes;   // of the current frame, in seconds
+    int                         m_objects;      // balls, faces or markers of the current frame
+    ResultWriter*               m_writer;
+    std::vector<ResultObject>   m_results;
+
+    // Of the last run()
+    std::vector<double>         m_stageSums, m_stageWorst;
+    double                      m_totalSum, m_totalWorst, m_elapsed;
+    long long                   m_frames, m_detected;
+
+    ColorRange                  m_range;
+    TrackingPipeline            m_pipeline;
+    BlobTracker                 m_ballTracker;
+
+    VideoFaceDetector           m_faceDetector;
+
+    aruco::MarkerDetector       m_markerDetector;
+    MarkerUndistortion          m_markerUndistortion;
+    aruco::CameraParameters     m_camera;
+    float                       m_markerSize;
+    cv::Mat                     m_flipped, m_background;
+    cv::Mat                     m_rvec, m_tvec;
+    std::vector<aruco::Marker>  m_markers;
+
+    bool                processFrame();
+    void                writeResults(const long long frame);
+    void                processColor();
+    void                processFace();
+    void                processMarkers();
+};
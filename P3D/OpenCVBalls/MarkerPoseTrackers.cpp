@@ -0,0 +1,155 @@
+#include "MarkerPoseTrackers.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <opencv2\calib3d.hpp>
+
+namespace
+{
+    // Frames a marker can go unseen and keep its tracker
+    const int MAX_MISSES = 3;
+
+    // Angle in degrees of the rotation between two rotation vectors
+    double rotationDifference(const cv::Mat &rvecA, const cv::Mat &rvecB)
+    {
+        cv::Mat a, b;
+        cv::Rodrigues(rvecA, a);
+        cv::Rodrigues(rvecB, b);
+        cv::Mat difference = a.t() * b;
+        double cosine = (cv::trace(difference)[0] - 1.0) / 2.0;
+        return std::acos(std::max(-1.0, std::min(1.0, cosine))) * 180.0 / CV_PI;
+    }
+}
+
+MarkerPoseTrackers::MarkerPoseTrackers()
+    : m_enabled(true)
+{
+}
+
+void MarkerPoseTrackers::setEnabled(const bool enabled)
+{
+    m_enabled = enabled;
+    reset();
+}
+
+bool MarkerPoseTrackers::enabled() const
+{
+    return m_enabled;
+}
+
+void MarkerPoseTrackers::reset()
+{
+    m_tracks.clear();
+}
+
+/*
+* Rvec / Tvec of every marker, like Marker::calculateExtrinsics(markerSize, camera, false).
+*/
+void MarkerPoseTrackers::estimatePoses(std::vector<aruco::Marker> &markers, const aruco::CameraParameters &camera, const float markerSize)
+{
+    if (!m_enabled) {
+        for (size_t i = 0; i < markers.size(); i++) {
+            markers[i].calculateExtrinsics(markerSize, camera, false);
+        }
+        return;
+    }
+
+    for (std::map<int, Track>::iterator it = m_tracks.begin(); it != m_tracks.end(); ++it) {
+        it->second.misses++;
+    }
+
+    for (size_t i = 0; i < markers.size(); i++) {
+        std::map<int, Track>::iterator it = m_tracks.find(markers[i].id);
+        if (it == m_tracks.end()) {
+            it = m_tracks.insert(std::make_pair(markers[i].id, Track())).first;
+        }
+        it->second.misses = 0;
+        it->second.tracker.estimatePose(markers[i], camera, markerSize);
+    }
+
+    for (std::map<int, Track>::iterator it = m_tracks.begin(); it != m_tracks.end();) {
+        if (it->second.misses > MAX_MISSES)
+            it = m_tracks.erase(it);
+        else
+            ++it;
+    }
+}
+
+/*
+* Pose time and jitter of calculateExtrinsics against the trackers, on a marker held still
+* a metre away and turned 10 degrees from the camera (close to where the planar ambiguity
+* appears), with gaussian noise of 0.3 pixels on its corners in each frame. Jitter is the
+* standard deviation of Tvec and the mean rotation between consecutive frames; a flip is
+* a frame whose rotation is more than 5 degrees away from the true one.
+*/
+void MarkerPoseTrackers::benchmark(const aruco::CameraParameters &camera, const float markerSize, const int frames)
+{
+    aruco::CameraParameters ideal(camera);
+    if (!camera.isValid()) {
+        cv::Mat matrix = (cv::Mat_<float>(3, 3) << 800, 0, 320, 0, 800, 240, 0, 0, 1);
+        ideal.setParams(matrix, cv::Mat::zeros(4, 1, CV_32FC1), cv::Size(640, 480));
+    }
+    ideal.Distorsion = cv::Mat::zeros(ideal.Distorsion.size(), ideal.Distorsion.type());
+
+    const float half = markerSize / 2;
+    std::vector<cv::Point3f> object;
+    object.push_back(cv::Point3f(-half, half, 0));
+    object.push_back(cv::Point3f(half, half, 0));
+    object.push_back(cv::Point3f(half, -half, 0));
+    object.push_back(cv::Point3f(-half, -half, 0));
+
+    cv::Mat trueRvec = (cv::Mat_<double>(3, 1) << 10.0 * CV_PI / 180.0, 0, 0);
+    cv::Mat trueTvec = (cv::Mat_<double>(3, 1) << 0.05, -0.03, 1.0);
+    std::vector<cv::Point2f> projected;
+    cv::projectPoints(object, trueRvec, trueTvec, ideal.CameraMatrix, ideal.Distorsion, projected);
+
+    // The same noisy corners for both, so only the pose estimation differs
+    cv::RNG rng(12345);
+    std::vector<aruco::Marker> sequence(frames);
+    for (int f = 0; f < frames; f++) {
+        for (int c = 0; c < 4; c++) {
+            sequence[f].push_back(projected[c] + cv::Point2f((float)rng.gaussian(0.3), (float)rng.gaussian(0.3)));
+        }
+        sequence[f].id = 7;
+    }
+
+    const char *names[] = { "calculateExtrinsics", "MarkerPoseTracker" };
+    std::cout << "Marker pose, " << frames << " frames:";
+    for (int method = 0; method < 2; method++) {
+        MarkerPoseTrackers trackers;
+        trackers.setEnabled(method == 1);
+
+        std::vector<aruco::Marker> markers(1);
+        cv::Mat previousRvec;
+        cv::Scalar sum, sumSquares;
+        double rotationJitter = 0, time = 0;
+        int flips = 0;
+        for (int f = 0; f < frames; f++) {
+            markers[0] = sequence[f];
+            int64 start = cv::getTickCount();
+            trackers.estimatePoses(markers, ideal, markerSize);
+            time += (cv::getTickCount() - start) / cv::getTickFrequency();
+
+            cv::Mat rvec, tvec;
+            markers[0].Rvec.convertTo(rvec, CV_64F);
+            markers[0].Tvec.convertTo(tvec, CV_64F);
+            for (int k = 0; k < 3; k++) {
+                sum[k] += tvec.at<double>(k);
+                sumSquares[k] += tvec.at<double>(k) * tvec.at<double>(k);
+            }
+            if (f > 0) rotationJitter += rotationDifference(previousRvec, rvec);
+            if (rotationDifference(trueRvec, rvec) > 5.0) flips++;
+            previousRvec = rvec;
+        }
+
+        double deviation = 0;
+        for (int k = 0; k < 3; k++) {
+            double mean = sum[k] / frames;
+            deviation += sumSquares[k] / frames - mean * mean;
+        }
+        std::cout << " | " << names[method] << " " << time / frames * 1000.0 << " ms, Tvec jitter "
+            << std::sqrt(std::max(deviation, 0.0)) * 1000.0 << " mm, rotation jitter " << rotationJitter / std::max(frames - 1, 1)
+            << " deg, " << flips << " flips";
+    }
+    std::cout << std::endl;
+}
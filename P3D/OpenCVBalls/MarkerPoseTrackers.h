@@ -0,0 +1,41 @@
+#pragma once
+
+#include <map>
+#include <vector>
+#include <opencv2\core.hpp>
+#include "Dependencies\aruco\aruco.h"
+#include "Dependencies\aruco\posetracker.h"
+
+/*
+* Pose of each marker found from the pose it had in the previous frame: one
+* aruco::MarkerPoseTracker per marker id, whose iterative PnP starts from the last Rvec /
+* Tvec instead of from scratch. Besides needing fewer iterations, this keeps a nearly
+* frontal marker on the same side of the planar ambiguity frame after frame, where
+* calculateExtrinsics can flip between the two solutions with the noise of the corners.
+*
+* A marker missing for more than MAX_MISSES frames loses its tracker, so it starts from
+* scratch when it comes back instead of from a pose that may be far from the new one.
+*/
+class MarkerPoseTrackers
+{
+public:
+    MarkerPoseTrackers();
+
+    void            setEnabled(const bool enabled);
+    bool            enabled() const;
+    void            reset();
+
+    void            estimatePoses(std::vector<aruco::Marker> &markers, const aruco::CameraParameters &camera, const float markerSize);
+
+    static void     benchmark(const aruco::CameraParameters &camera, const float markerSize, const int frames);
+
+private:
+    struct Track
+    {
+        aruco::MarkerPoseTracker    tracker;
+        int                         misses;
+    };
+
+    bool                    m_enabled;
+    std::map<int, Track>    m_tracks;   // by marker id
+};
@@ -0,0 +1,393 @@
+#include "MarkerRoiDetector.h"
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+#include <opencv2\imgproc.hpp>
+
+namespace
+{
+    // Pixels added around a small marker's bounding box, at least
+    const int MIN_EXPANSION = 16;
+    // Windows whose smaller side would shrink below this are searched at full resolution
+    const int MIN_SCALED_WINDOW = 64;
+}
+
+MarkerRoiDetector::MarkerRoiDetector(const int fullFrameInterval)
+    : m_enabled(true), m_fullFrameInterval(fullFrameInterval), m_scale(0), m_parallel(false)
+{
+    reset();
+}
+
+void MarkerRoiDetector::setEnabled(const bool enabled)
+{
+    m_enabled = enabled;
+    reset();
+}
+
+bool MarkerRoiDetector::enabled() const
+{
+    return m_enabled;
+}
+
+void MarkerRoiDetector::setFullFrameInterval(const int frames)
+{
+    m_fullFrameInterval = frames;
+}
+
+void MarkerRoiDetector::setScale(const int scale)
+{
+    m_scale = scale;
+}
+
+int MarkerRoiDetector::scale() const
+{
+    return m_scale;
+}
+
+void MarkerRoiDetector::setParallel(const bool parallel)
+{
+    m_parallel = parallel;
+}
+
+bool MarkerRoiDetector::parallel() const
+{
+    return m_parallel;
+}
+
+void MarkerRoiDetector::find(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers)
+{
+    if (m_parallel)
+        m_parallelDetector.detect(detector, image, markers);
+    else
+        detector.detect(image, markers);
+}
+
+int MarkerRoiDetector::scaleFor(const cv::Size &size) const
+{
+    if (m_scale > 0) return m_scale;
+
+    int scale = 1;
+    while (scale < 4 && size.width / (scale * 2) >= 640) {
+        scale *= 2;
+    }
+    return scale;
+}
+
+void MarkerRoiDetector::reset()
+{
+    m_previous.clear();
+    m_framesSinceFull = 0;
+    m_lastWasFullFrame = true;
+}
+
+bool MarkerRoiDetector::lastWasFullFrame() const
+{
+    return m_lastWasFullFrame;
+}
+
+/*
+* Corners of the markers in image (no pose).
+*/
+void MarkerRoiDetector::detect(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers)
+{
+    m_context.reset(image);
+    detect(detector, m_context, markers);
+}
+
+/*
+* Same, on the grey image and pyramid of the frame's context: every search gets grey
+* input, so neither aruco nor the refinement converts the frame again.
+*/
+void MarkerRoiDetector::detect(aruco::MarkerDetector &detector, FrameContext &frame, std::vector<aruco::Marker> &markers)
+{
+    bool full = !m_enabled || m_previous.empty() || ++m_framesSinceFull >= m_fullFrameInterval;
+
+    if (!full) {
+        computeWindows(frame.size());
+        detectInWindows(detector, frame, markers);
+        // A marker went out of its window (or out of view): look everywhere
+        full = markers.size() < m_previous.size();
+    }
+    if (full) {
+        detectScaled(detector, frame, cv::Rect(cv::Point(0, 0), frame.size()), markers, scaleFor(frame.size()));
+        m_framesSinceFull = 0;
+    }
+
+    m_lastWasFullFrame = full;
+    m_previous = markers;
+}
+
+/*
+* Markers inside window of the frame, found in the pyramid level of 1 / scale of its
+* resolution (scale rounded down to a power of two), with the corners refined in the full
+* resolution grey image. The corners are relative to the window.
+*/
+void MarkerRoiDetector::detectScaled(aruco::MarkerDetector &detector, FrameContext &frame, const cv::Rect &window,
+    std::vector<aruco::Marker> &markers, const int scale)
+{
+    int level = 0;
+    while ((2 << level) <= scale) level++;
+
+    const cv::Mat &gray = frame.gray();
+    if (level == 0) {
+        find(detector, gray(window), markers);
+        return;
+    }
+
+    const int levelScale = 1 << level;
+    const cv::Mat &small = frame.pyramid(level);
+    cv::Rect smallWindow(window.x / levelScale, window.y / levelScale, window.width / levelScale, window.height / levelScale);
+    smallWindow &= cv::Rect(0, 0, small.cols, small.rows);
+    find(detector, small(smallWindow), markers);
+    if (markers.empty()) return;
+
+    // Pixel (x, y) of a pyramid level is centred on pixel (2x, 2y) of the level below
+    const cv::Point2f smallOrigin((float)smallWindow.x, (float)smallWindow.y), origin((float)window.x, (float)window.y);
+    m_corners.clear();
+    for (size_t i = 0; i < markers.size(); i++) {
+        for (size_t c = 0; c < markers[i].size(); c++) {
+            m_corners.push_back((markers[i][c] + smallOrigin) * (float)levelScale);
+        }
+    }
+
+    // The search window covers the error of the mapped corners
+    cv::cornerSubPix(gray, m_corners, cv::Size(levelScale + 1, levelScale + 1), cv::Size(-1, -1),
+        cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS, 12, 0.01));
+
+    size_t corner = 0;
+    for (size_t i = 0; i < markers.size(); i++) {
+        for (size_t c = 0; c < markers[i].size(); c++) {
+            markers[i][c] = m_corners[corner++] - origin;
+        }
+    }
+}
+
+void MarkerRoiDetector::computeWindows(const cv::Size &imageSize)
+{
+    const cv::Rect frame(cv::Point(0, 0), imageSize);
+    m_windows.clear();
+
+    for (size_t i = 0; i < m_previous.size(); i++) {
+        cv::Rect box = cv::boundingRect(cv::Mat(m_previous[i]));
+        int expandX = std::max(box.width / 2, MIN_EXPANSION), expandY = std::max(box.height / 2, MIN_EXPANSION);
+        cv::Rect window(box.x - expandX, box.y - expandY, box.width + 2 * expandX, box.height + 2 * expandY);
+        window &= frame;
+
+        // Merge with any window it overlaps, repeatedly, since the union can reach others
+        bool merged = true;
+        while (merged) {
+            merged = false;
+            for (size_t w = 0; w < m_windows.size(); w++) {
+                if ((m_windows[w] & window).area() > 0) {
+                    window |= m_windows[w];
+                    m_windows.erase(m_windows.begin() + w);
+                    merged = true;
+                    break;
+                }
+            }
+        }
+        m_windows.push_back(window);
+    }
+}
+
+void MarkerRoiDetector::detectInWindows(aruco::MarkerDetector &detector, FrameContext &frame, std::vector<aruco::Marker> &markers)
+{
+    markers.clear();
+
+    // Marker sizes are limits relative to the image searched, and a marker fills much of its window
+    aruco::MarkerDetector::Params params = detector.getParams();
+    aruco::MarkerDetector::Params windowParams = params;
+    windowParams._maxSize = 1.0f;
+    detector.setParams(windowParams);
+
+    const int scale = scaleFor(frame.size());
+    for (size_t w = 0; w < m_windows.size(); w++) {
+        const cv::Rect &window = m_windows[w];
+        bool scaled = scale > 1 && std::min(window.width, window.height) / scale >= MIN_SCALED_WINDOW;
+        detectScaled(detector, frame, window, m_windowMarkers, scaled ? scale : 1);
+
+        for (size_t i = 0; i < m_windowMarkers.size(); i++) {
+            aruco::Marker &marker = m_windowMarkers[i];
+            bool duplicate = false;
+            for (size_t j = 0; j < markers.size(); j++) {
+                duplicate = duplicate || markers[j].id == marker.id;
+            }
+            if (duplicate) continue;
+
+            for (size_t c = 0; c < marker.size(); c++) {
+                marker[c].x += window.x;
+                marker[c].y += window.y;
+            }
+            markers.push_back(marker);
+        }
+    }
+
+    detector.setParams(params);
+}
+
+/*
+* Times full frame detection against the window search on a synthetic frame with
+* markerCount markers of the default dictionary that move a little every frame, and
+* checks that both find the same markers at the same place.
+*/
+void MarkerRoiDetector::benchmark(const cv::Size &frameSize, const int markerCount, const int frames)
+{
+    aruco::Dictionary dictionary = aruco::Dictionary::loadPredefined(aruco::Dictionary::ARUCO);
+    cv::Mat background(frameSize, CV_8UC1);
+    cv::randu(background, cv::Scalar(90), cv::Scalar(170));
+    cv::GaussianBlur(background, background, cv::Size(5, 5), 2);
+
+    const int side = std::min(frameSize.width, frameSize.height) / 6;
+    std::vector<cv::Mat> markerImages;
+    std::vector<cv::Point> positions;
+    for (int i = 0; i < markerCount; i++) {
+        cv::Mat image = dictionary.getMarkerImage_id(i * 7 + 1, 10, false), scaled;
+        cv::resize(image, scaled, cv::Size(side, side), 0, 0, cv::INTER_NEAREST);
+        // White quiet zone around the marker
+        cv::copyMakeBorder(scaled, scaled, side / 6, side / 6, side / 6, side / 6, cv::BORDER_CONSTANT, cv::Scalar(255));
+        markerImages.push_back(scaled);
+        int columns = std::max(frameSize.width / (scaled.cols + 20), 1);
+        positions.push_back(cv::Point(10 + (i % columns) * (scaled.cols + 20), 10 + (i / columns) * (scaled.rows + 20)));
+    }
+
+    std::vector<cv::Mat> sequence(16);
+    for (size_t f = 0; f < sequence.size(); f++) {
+        cv::Mat gray = background.clone();
+        for (int i = 0; i < markerCount; i++) {
+            cv::Point p = positions[i] + cv::Point((int)f * 2, (int)f);
+            cv::Rect place(p, markerImages[i].size());
+            if ((place & cv::Rect(cv::Point(0, 0), frameSize)) == place) {
+                cv::Mat target = gray(place);
+                markerImages[i].copyTo(target);
+            }
+        }
+        cv::cvtColor(gray, sequence[f], cv::COLOR_GRAY2BGR);
+    }
+
+    aruco::MarkerDetector detector;
+    std::vector<aruco::Marker> full, windowed;
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        detector.detect(sequence[i % sequence.size()], full);
+    }
+    double fullTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    MarkerRoiDetector roiDetector;
+    int fullFrames = 0, mismatches = 0;
+    double cornerError = 0;
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        roiDetector.detect(detector, sequence[i % sequence.size()], windowed);
+        fullFrames += roiDetector.lastWasFullFrame() ? 1 : 0;
+    }
+    double windowTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    // Accuracy, outside the timing
+    for (size_t f = 0; f < sequence.size(); f++) {
+        roiDetector.detect(detector, sequence[f], windowed);
+        detector.detect(sequence[f], full);
+        if (windowed.size() != full.size()) {
+            mismatches++;
+            continue;
+        }
+        for (size_t i = 0; i < full.size(); i++) {
+            for (size_t j = 0; j < windowed.size(); j++) {
+                if (windowed[j].id != full[i].id) continue;
+                for (int c = 0; c < 4; c++) {
+                    cv::Point2f d = windowed[j][c] - full[i][c];
+                    cornerError = std::max(cornerError, (double)std::sqrt(d.dot(d)));
+                }
+            }
+        }
+    }
+
+    std::cout << "Marker detection " << frameSize.width << "x" << frameSize.height << ", " << markerCount << " marker(s): full frame "
+        << fullTime * 1000.0 << " ms, windows " << windowTime * 1000.0 << " ms per frame (" << fullTime / windowTime
+        << "x, " << fullFrames << " of " << frames << " frames searched in full), " << mismatches
+        << " frames with a different marker count, largest corner difference " << cornerError << " px" << std::endl;
+}
+
+/*
+* Times full resolution detection against detection at 1 / scale with the corner
+* refinement, on a synthetic frame with four rotated markers, and prints how far the
+* corners and the poses (for an ideal camera with a focal length of the frame width)
+* end up from the full resolution ones.
+*/
+void MarkerRoiDetector::benchmarkScale(const cv::Size &frameSize, const int scale, const int frames)
+{
+    aruco::Dictionary dictionary = aruco::Dictionary::loadPredefined(aruco::Dictionary::ARUCO);
+
+    cv::Mat gray(frameSize, CV_8UC1), frame;
+    cv::randu(gray, cv::Scalar(90), cv::Scalar(170));
+    cv::GaussianBlur(gray, gray, cv::Size(5, 5), 2);
+
+    const int side = std::min(frameSize.width, frameSize.height) / 5;
+    for (int i = 0; i < 4; i++) {
+        cv::Mat image = dictionary.getMarkerImage_id(i * 11 + 3, 10, false), scaled;
+        cv::resize(image, scaled, cv::Size(side, side), 0, 0, cv::INTER_NEAREST);
+        cv::copyMakeBorder(scaled, scaled, side / 6, side / 6, side / 6, side / 6, cv::BORDER_CONSTANT, cv::Scalar(255));
+
+        // Rotated a different amount each, in its own quarter of the frame
+        cv::Point2f center((i % 2 + 0.5f) * frameSize.width / 2, (i / 2 + 0.5f) * frameSize.height / 2);
+        cv::Mat rotation = cv::getRotationMatrix2D(cv::Point2f(scaled.cols / 2.0f, scaled.rows / 2.0f), 10.0 + 20.0 * i, 1.0);
+        rotation.at<double>(0, 2) += center.x - scaled.cols / 2.0f;
+        rotation.at<double>(1, 2) += center.y - scaled.rows / 2.0f;
+        cv::warpAffine(scaled, gray, rotation, frameSize, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+    }
+    cv::GaussianBlur(gray, gray, cv::Size(3, 3), 0.8);
+    cv::cvtColor(gray, frame, cv::COLOR_GRAY2BGR);
+
+    cv::Mat cameraMatrix = (cv::Mat_<float>(3, 3) << (float)frameSize.width, 0, frameSize.width / 2.0f,
+        0, (float)frameSize.width, frameSize.height / 2.0f, 0, 0, 1);
+    aruco::CameraParameters camera(cameraMatrix, cv::Mat::zeros(4, 1, CV_32F), frameSize);
+    const float markerSize = 0.045f;
+
+    aruco::MarkerDetector detector;
+    std::vector<aruco::Marker> full, coarse;
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        detector.detect(frame, full);
+    }
+    double fullTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    MarkerRoiDetector roiDetector;
+    roiDetector.setEnabled(false);
+    roiDetector.setScale(scale);
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        roiDetector.detect(detector, frame, coarse);
+    }
+    double coarseTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    double cornerError = 0, translationError = 0, rotationError = 0;
+    int matched = 0;
+    for (size_t i = 0; i < full.size(); i++) {
+        for (size_t j = 0; j < coarse.size(); j++) {
+            if (coarse[j].id != full[i].id) continue;
+            matched++;
+            for (int c = 0; c < 4; c++) {
+                cv::Point2f d = coarse[j][c] - full[i][c];
+                cornerError = std::max(cornerError, (double)std::sqrt(d.dot(d)));
+            }
+            full[i].calculateExtrinsics(markerSize, camera, false);
+            coarse[j].calculateExtrinsics(markerSize, camera, false);
+            translationError = std::max(translationError, cv::norm(full[i].Tvec, coarse[j].Tvec));
+
+            // Angle of the rotation between the two poses
+            cv::Mat r1, r2;
+            cv::Rodrigues(full[i].Rvec, r1);
+            cv::Rodrigues(coarse[j].Rvec, r2);
+            cv::Mat relative = r1.t() * r2;
+            double cosine = std::max(-1.0, std::min(1.0, (cv::trace(relative)[0] - 1) / 2));
+            rotationError = std::max(rotationError, std::acos(cosine) * 180.0 / CV_PI);
+        }
+    }
+
+    std::cout << "Marker detection " << frameSize.width << "x" << frameSize.height << " at 1/" << scale << ": full "
+        << fullTime * 1000.0 << " ms, coarse + refinement " << coarseTime * 1000.0 << " ms per frame ("
+        << fullTime / coarseTime << "x), " << matched << " of " << full.size() << " markers found by both, largest difference "
+        << cornerError << " px in corners, " << translationError * 1000.0 << " mm in position, " << rotationError
+        << " degrees in rotation" << std::endl;
+}
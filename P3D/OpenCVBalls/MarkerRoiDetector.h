@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <opencv2\core.hpp>
+#include "Dependencies\aruco\aruco.h"
+#include "ParallelMarkerDetector.h"
+#include "FrameContext.h"
+
+/*
+* Finds aruco markers frame after frame without searching the whole image each time:
+* once markers are found, the next frame is only searched inside a window around each
+* one (twice its bounding box, overlapping windows merged). The whole frame is searched
+* again every fullFrameInterval frames, to pick up new markers, and as soon as a window
+* search finds fewer markers than the previous frame had.
+*
+* Only the corners are found, in full frame coordinates; the pose is left to the caller,
+* so Marker::calculateExtrinsics / glGetModelViewMatrix work as with a full detection.
+*
+* With a scale above 1, candidates are searched in the level of the frame's grey pyramid
+* shrunk by that factor, where thresholding and contour finding are much cheaper, and
+* their corners are mapped back up and refined with cornerSubPix on the full resolution
+* grey image. Scale 0 picks the largest of 1, 2 and 4 that leaves the shrunk image at
+* least 640 pixels wide.
+*
+* With parallel detection on, every search goes through a ParallelMarkerDetector instead
+* of the detector's own single threaded detect(). It is off by default: the parallel
+* detector refines corners with cornerSubPix rather than the library's LINES method, so
+* its corners are close to aruco's but not the same.
+*/
+class MarkerRoiDetector
+{
+public:
+    MarkerRoiDetector(const int fullFrameInterval = 10);
+
+    void            setEnabled(const bool enabled);
+    bool            enabled() const;
+    void            setFullFrameInterval(const int frames);
+    void            setScale(const int scale);
+    int             scale() const;
+    void            setParallel(const bool parallel);
+    bool            parallel() const;
+    void            reset();
+
+    void            detect(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers);
+    void            detect(aruco::MarkerDetector &detector, FrameContext &frame, std::vector<aruco::Marker> &markers);
+    bool            lastWasFullFrame() const;
+
+    static void     benchmark(const cv::Size &frameSize, const int markerCount, const int frames);
+    static void     benchmarkScale(const cv::Size &frameSize, const int scale, const int frames);
+
+private:
+    bool                        m_enabled;
+    int                         m_fullFrameInterval;
+    int                         m_framesSinceFull;
+    bool                        m_lastWasFullFrame;
+    std::vector<aruco::Marker>  m_previous;
+    std::vector<cv::Rect>       m_windows;
+    std::vector<aruco::Marker>  m_windowMarkers;
+    int                         m_scale;
+    FrameContext                m_context;          // for images given to detect() as a Mat
+    std::vector<cv::Point2f>    m_corners;
+    bool                        m_parallel;
+    ParallelMarkerDetector      m_parallelDetector;
+
+    void            find(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers);
+    int             scaleFor(const cv::Size &size) const;
+    void            detectScaled(aruco::MarkerDetector &detector, FrameContext &frame, const cv::Rect &window,
+                        std::vector<aruco::Marker> &markers, const int scale);
+    void            computeWindows(const cv::Size &imageSize);
+    void            detectInWindows(aruco::MarkerDetector &detector, FrameContext &frame, std::vector<aruco::Marker> &markers);
+};
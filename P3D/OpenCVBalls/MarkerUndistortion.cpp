@@ -0,0 +1,197 @@
+#include "MarkerUndistortion.h"
+#include <iostream>
+#include <opencv2\imgproc.hpp>
+
+namespace
+{
+    // Rows per band of the parallel remap
+    const int BAND_ROWS = 32;
+
+    class RemapBody : public cv::ParallelLoopBody
+    {
+    public:
+        RemapBody(const cv::Mat &src, cv::Mat &dst, const cv::Mat &map1, const cv::Mat &map2)
+            : m_src(src), m_dst(dst), m_map1(map1), m_map2(map2)
+        {
+        }
+
+        void operator()(const cv::Range &bands) const
+        {
+            cv::Range rows(bands.start * BAND_ROWS, std::min(bands.end * BAND_ROWS, m_dst.rows));
+            cv::Mat dst = m_dst.rowRange(rows);
+            cv::remap(m_src, dst, m_map1.rowRange(rows), m_map2.rowRange(rows), cv::INTER_LINEAR);
+        }
+
+    private:
+        const cv::Mat&  m_src;
+        cv::Mat&        m_dst;
+        const cv::Mat&  m_map1;
+        const cv::Mat&  m_map2;
+    };
+
+    bool sameMat(const cv::Mat &a, const cv::Mat &b)
+    {
+        return a.size() == b.size() && a.type() == b.type() && (a.empty() || cv::countNonZero(a.reshape(1) != b.reshape(1)) == 0);
+    }
+}
+
+MarkerUndistortion::MarkerUndistortion()
+    : m_mode(REMAP_FRAME)
+{
+}
+
+void MarkerUndistortion::setMode(const Mode mode)
+{
+    m_mode = mode;
+    // The windows are in the coordinates of the image searched, which changes with the mode
+    m_search.reset();
+}
+
+MarkerUndistortion::Mode MarkerUndistortion::mode() const
+{
+    return m_mode;
+}
+
+MarkerRoiDetector& MarkerUndistortion::search()
+{
+    return m_search;
+}
+
+MarkerPoseTrackers& MarkerUndistortion::poses()
+{
+    return m_poses;
+}
+
+/*
+* Finds the markers of frame and their pose. background is the image to draw behind them:
+* the undistorted frame, or the frame itself when only the corners are undistorted. The
+* undistorted frame gets a context of its own, since none of frame's images apply to it.
+*/
+void MarkerUndistortion::detect(aruco::MarkerDetector &detector, FrameContext &frame, const aruco::CameraParameters &camera,
+    const float markerSize, std::vector<aruco::Marker> &markers, cv::Mat &background)
+{
+    drawingBackground(frame.image(), camera, background);
+    if (m_mode == UNDISTORT_CORNERS) {
+        m_search.detect(detector, frame, markers);
+        undistortCorners(markers, camera);
+    }
+    else {
+        m_undistorted.reset(background);
+        m_search.detect(detector, m_undistorted, markers);
+    }
+
+    m_poses.estimatePoses(markers, withoutDistortion(camera), markerSize);
+}
+
+/*
+* Only the image detect() would draw behind the markers, for frames whose markers are not
+* searched again.
+*/
+void MarkerUndistortion::drawingBackground(const cv::Mat &frame, const aruco::CameraParameters &camera, cv::Mat &background)
+{
+    if (m_mode == UNDISTORT_CORNERS) {
+        background = frame;
+    }
+    else if (m_mode == UNDISTORT_FRAME) {
+        cv::undistort(frame, background, camera.CameraMatrix, camera.Distorsion);
+    }
+    else {
+        undistortFrame(frame, camera, background);
+    }
+}
+
+void MarkerUndistortion::prepareMaps(const aruco::CameraParameters &camera, const cv::Size &size)
+{
+    if (size == m_mapSize && sameMat(camera.CameraMatrix, m_mapCamera) && sameMat(camera.Distorsion, m_mapDistortion)) return;
+
+    cv::initUndistortRectifyMap(camera.CameraMatrix, camera.Distorsion, cv::Mat(), camera.CameraMatrix, size,
+        CV_16SC2, m_map1, m_map2);
+    m_mapSize = size;
+    camera.CameraMatrix.copyTo(m_mapCamera);
+    camera.Distorsion.copyTo(m_mapDistortion);
+}
+
+void MarkerUndistortion::undistortFrame(const cv::Mat &frame, const aruco::CameraParameters &camera, cv::Mat &undistorted)
+{
+    prepareMaps(camera, frame.size());
+
+    undistorted.create(frame.size(), frame.type());
+    const int bands = (frame.rows + BAND_ROWS - 1) / BAND_ROWS;
+    cv::parallel_for_(cv::Range(0, bands), RemapBody(frame, undistorted, m_map1, m_map2));
+}
+
+/*
+* Moves the corners of each marker to where they would be in the undistorted image.
+*/
+void MarkerUndistortion::undistortCorners(std::vector<aruco::Marker> &markers, const aruco::CameraParameters &camera)
+{
+    for (size_t i = 0; i < markers.size(); i++) {
+        cv::undistortPoints((const std::vector<cv::Point2f>&)markers[i], m_corners, camera.CameraMatrix, camera.Distorsion, cv::noArray(), camera.CameraMatrix);
+        for (size_t c = 0; c < markers[i].size(); c++) {
+            markers[i][c] = m_corners[c];
+        }
+    }
+}
+
+aruco::CameraParameters MarkerUndistortion::withoutDistortion(const aruco::CameraParameters &camera)
+{
+    aruco::CameraParameters ideal(camera);
+    ideal.Distorsion = cv::Mat::zeros(camera.Distorsion.size(), camera.Distorsion.type());
+    return ideal;
+}
+
+/*
+* Times the three modes on a synthetic frame of the calibrated size (640x480 if unknown): the
+* image work of the first two, and the corner work of the last (16 markers). Also checks
+* that the cached remap gives the same image as cv::undistort, within rounding.
+*/
+void MarkerUndistortion::benchmark(const aruco::CameraParameters &camera, const int frames)
+{
+    cv::Size size = camera.CamSize.width > 0 ? camera.CamSize : cv::Size(640, 480);
+    cv::Mat frame(size, CV_8UC3), reference, remapped;
+    cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::GaussianBlur(frame, frame, cv::Size(7, 7), 2);
+
+    MarkerUndistortion undistortion;
+
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        cv::undistort(frame, reference, camera.CameraMatrix, camera.Distorsion);
+    }
+    double undistortTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    start = cv::getTickCount();
+    undistortion.undistortFrame(frame, camera, remapped);
+    double mapTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        undistortion.undistortFrame(frame, camera, remapped);
+    }
+    double remapTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    cv::Mat difference;
+    cv::absdiff(reference, remapped, difference);
+    double maxDifference;
+    cv::minMaxLoc(difference.reshape(1), NULL, &maxDifference);
+
+    std::vector<aruco::Marker> markers(16);
+    cv::RNG rng(12345);
+    for (size_t i = 0; i < markers.size(); i++) {
+        for (int c = 0; c < 4; c++) {
+            markers[i].push_back(cv::Point2f(rng.uniform(0.f, (float)size.width), rng.uniform(0.f, (float)size.height)));
+        }
+    }
+    std::vector<aruco::Marker> corners;
+    start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        corners = markers;
+        undistortion.undistortCorners(corners, camera);
+    }
+    double cornersTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    std::cout << "Undistort " << size.width << "x" << size.height << ": cv::undistort " << undistortTime * 1000.0
+        << " ms, cached remap " << remapTime * 1000.0 << " ms (maps built once in " << mapTime * 1000.0
+        << " ms, largest difference " << maxDifference << "), corners of " << markers.size() << " markers "
+        << cornersTime * 1000.0 << " ms per frame" << std::endl;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <opencv2\core.hpp>
+#include "Dependencies\aruco\aruco.h"
+#include "MarkerRoiDetector.h"
+#include "MarkerPoseTrackers.h"
+#include "FrameContext.h"
+
+/*
+* Takes the lens distortion out of the marker mode, in one of three ways:
+*
+* UNDISTORT_FRAME     cv::undistort of every frame, which builds the maps again each time.
+* REMAP_FRAME         the maps are built once per resolution / camera (fixed point CV_16SC2)
+*                     and the frame is remapped in parallel bands of rows.
+* UNDISTORT_CORNERS   the frame is left as it is; markers are found in it and only their
+*                     corners are undistorted before the pose is computed.
+*
+* In the first two the markers are found in an undistorted image, so the pose is computed
+* without distortion coefficients. In all of them the markers are searched through a
+* MarkerRoiDetector, in windows around the previous frame's markers, and the pose of each
+* one starts from its pose in the previous frame (MarkerPoseTrackers).
+*/
+class MarkerUndistortion
+{
+public:
+    enum Mode
+    {
+        UNDISTORT_FRAME,
+        REMAP_FRAME,
+        UNDISTORT_CORNERS,
+        MODES
+    };
+
+    MarkerUndistortion();
+
+    void            setMode(const Mode mode);
+    Mode            mode() const;
+    MarkerRoiDetector&  search();
+    MarkerPoseTrackers& poses();
+
+    void            detect(aruco::MarkerDetector &detector, FrameContext &frame, const aruco::CameraParameters &camera,
+                        const float markerSize, std::vector<aruco::Marker> &markers, cv::Mat &background);
+    void            drawingBackground(const cv::Mat &frame, const aruco::CameraParameters &camera, cv::Mat &background);
+    void            undistortFrame(const cv::Mat &frame, const aruco::CameraParameters &camera, cv::Mat &undistorted);
+    void            undistortCorners(std::vector<aruco::Marker> &markers, const aruco::CameraParameters &camera);
+
+    static void     benchmark(const aruco::CameraParameters &camera, const int frames);
+
+private:
+    Mode                        m_mode;
+    cv::Mat                     m_map1, m_map2;
+    cv::Size                    m_mapSize;
+    cv::Mat                     m_mapCamera, m_mapDistortion;   // what the maps were built for
+    std::vector<cv::Point2f>    m_corners;
+    FrameContext                m_undistorted;
+    MarkerRoiDetector           m_search;
+    MarkerPoseTrackers          m_poses;
+
+    void            prepareMaps(const aruco::CameraParameters &camera, const cv::Size &size);
+    static aruco::CameraParameters  withoutDistortion(const aruco::CameraParameters &camera);
+};
@@ -0,0 +1,92 @@
+#include "MotionFilter.h"
+#include <algorithm>
+
+const double MotionFilter::MAX_PREDICTION = 0.25;
+
+MotionFilter::MotionFilter(const double processNoise, const double measurementNoise)
+    : m_processNoise(processNoise), m_measurementNoise(measurementNoise)
+{
+    reset();
+}
+
+void MotionFilter::setNoise(const double processNoise, const double measurementNoise)
+{
+    m_processNoise = processNoise;
+    m_measurementNoise = measurementNoise;
+}
+
+void MotionFilter::reset()
+{
+    m_initialized = false;
+    m_time = 0;
+    m_position = m_velocity = 0;
+    m_p00 = m_p01 = m_p11 = 0;
+}
+
+bool MotionFilter::initialized() const
+{
+    return m_initialized;
+}
+
+/*
+* Moves the state dt seconds forward: x += v * dt, and the covariance grows by the
+* process noise of a random acceleration over dt.
+*/
+void MotionFilter::advance(const double dt)
+{
+    m_position += m_velocity * dt;
+
+    double q = m_processNoise;
+    double p00 = m_p00 + 2 * dt * m_p01 + dt * dt * m_p11 + q * dt * dt * dt / 3;
+    double p01 = m_p01 + dt * m_p11 + q * dt * dt / 2;
+    double p11 = m_p11 + q * dt;
+    m_p00 = p00;
+    m_p01 = p01;
+    m_p11 = p11;
+}
+
+void MotionFilter::correct(const double measurement, const double time)
+{
+    if (!m_initialized) {
+        m_position = measurement;
+        m_velocity = 0;
+        m_p00 = m_measurementNoise;
+        m_p01 = 0;
+        m_p11 = 1e6;
+        m_time = time;
+        m_initialized = true;
+        return;
+    }
+
+    // Measurements older than the state (out of order) are applied at the state's time
+    advance(std::max(time - m_time, 0.0));
+    m_time = std::max(time, m_time);
+
+    double innovation = measurement - m_position;
+    double s = m_p00 + m_measurementNoise;
+    double k0 = m_p00 / s, k1 = m_p01 / s;
+
+    m_position += k0 * innovation;
+    m_velocity += k1 * innovation;
+
+    double p00 = (1 - k0) * m_p00;
+    double p01 = (1 - k0) * m_p01;
+    double p11 = m_p11 - k1 * m_p01;
+    m_p00 = p00;
+    m_p01 = p01;
+    m_p11 = p11;
+}
+
+/*
+* Value expected at time, extrapolated from the last measurement with the current velocity.
+*/
+double MotionFilter::predict(const double time) const
+{
+    double dt = std::min(std::max(time - m_time, 0.0), MAX_PREDICTION);
+    return m_position + m_velocity * dt;
+}
+
+double MotionFilter::velocity() const
+{
+    return m_velocity;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+* Constant velocity Kalman filter for one tracked quantity (a coordinate or a radius).
+* Measurements and predictions are stamped in seconds, so detections can arrive at any
+* rate and the value can be extrapolated to the moment a frame is rendered.
+*
+* processNoise is the spectral density of the unmodelled acceleration (units^2 / s^3):
+* larger values follow sudden changes of direction faster. measurementNoise is the
+* variance of a detection (units^2): larger values smooth more.
+*/
+class MotionFilter
+{
+public:
+    MotionFilter(const double processNoise = 1e5, const double measurementNoise = 4.0);
+
+    void    setNoise(const double processNoise, const double measurementNoise);
+    void    reset();
+    bool    initialized() const;
+
+    void    correct(const double measurement, const double time);
+    double  predict(const double time) const;
+    double  velocity() const;
+
+private:
+    // Beyond this, a prediction without new measurements is not worth trusting
+    static const double MAX_PREDICTION;
+
+    double  m_processNoise;
+    double  m_measurementNoise;
+    bool    m_initialized;
+    double  m_time;
+    double  m_position, m_velocity;
+    double  m_p00, m_p01, m_p11;        // covariance of (position, velocity)
+
+    void    advance(const double dt);
+};
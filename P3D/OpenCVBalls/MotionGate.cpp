@@ -0,0 +1,113 @@
+#include "MotionGate.h"
+#include <opencv2\imgproc.hpp>
+
+MotionGate::MotionGate()
+    : m_enabled(true), m_pixelThreshold(12), m_changedFraction(0.002), m_maxSkipped(30)
+{
+    reset();
+    resetCounters();
+}
+
+void MotionGate::setEnabled(const bool enabled)
+{
+    m_enabled = enabled;
+    reset();
+}
+
+bool MotionGate::enabled() const
+{
+    return m_enabled;
+}
+
+void MotionGate::setPixelThreshold(const int levels)
+{
+    m_pixelThreshold = levels;
+}
+
+int MotionGate::pixelThreshold() const
+{
+    return m_pixelThreshold;
+}
+
+void MotionGate::setChangedFraction(const double fraction)
+{
+    m_changedFraction = fraction;
+}
+
+double MotionGate::changedFraction() const
+{
+    return m_changedFraction;
+}
+
+void MotionGate::setMaxSkipped(const int frames)
+{
+    m_maxSkipped = frames;
+}
+
+int MotionGate::maxSkipped() const
+{
+    return m_maxSkipped;
+}
+
+/*
+* The next frame runs the detector (e.g. after a mode change, when the last result
+* belongs to another detector).
+*/
+void MotionGate::reset()
+{
+    m_reference.release();
+    m_skippedInRow = 0;
+    m_motion = 0;
+}
+
+/*
+* True when the detector has to run on frame, false when its last result can be reused.
+*/
+bool MotionGate::update(FrameContext &frame)
+{
+    if (!m_enabled) {
+        m_executed++;
+        return true;
+    }
+
+    const cv::Mat &small = frame.pyramid(frame.levelFor(frame.size().width / SCALE));
+
+    bool run = m_reference.size() != small.size() || m_skippedInRow >= m_maxSkipped;
+    if (!run) {
+        cv::absdiff(small, m_reference, m_difference);
+        cv::threshold(m_difference, m_difference, m_pixelThreshold, 255, cv::THRESH_BINARY);
+        m_motion = (double)cv::countNonZero(m_difference) / small.total();
+        run = m_motion > m_changedFraction;
+    }
+
+    if (run) {
+        small.copyTo(m_reference);
+        m_skippedInRow = 0;
+        m_executed++;
+    }
+    else {
+        m_skippedInRow++;
+        m_skipped++;
+    }
+    return run;
+}
+
+double MotionGate::motion() const
+{
+    return m_motion;
+}
+
+long long MotionGate::executed() const
+{
+    return m_executed;
+}
+
+long long MotionGate::skipped() const
+{
+    return m_skipped;
+}
+
+void MotionGate::resetCounters()
+{
+    m_executed = m_skipped = 0;
+}
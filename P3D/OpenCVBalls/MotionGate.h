@@ -0,0 +1,52 @@
+#pragma once
+
+#include <opencv2\core.hpp>
+#include "FrameContext.h"
+
+/*
+* Decides, frame by frame, whether a detector needs to run or its last result still holds.
+* The frame is compared with the one the detector last ran on, both at 1/8 of the
+* resolution (a level of the frame's grey pyramid, so the comparison costs a few thousand
+* pixels): when fewer than changedFraction of the pixels differ by more than pixelThreshold
+* grey levels, nothing moved and the detection is skipped.
+*
+* Comparing with the last detected frame rather than the previous one, slow motion adds up
+* until it is seen. The detector still runs every maxSkipped frames, so lighting changes
+* and anything the comparison misses are picked up within a bounded time.
+*/
+class MotionGate
+{
+public:
+    MotionGate();
+
+    void        setEnabled(const bool enabled);
+    bool        enabled() const;
+    void        setPixelThreshold(const int levels);
+    int         pixelThreshold() const;
+    void        setChangedFraction(const double fraction);
+    double      changedFraction() const;
+    void        setMaxSkipped(const int frames);
+    int         maxSkipped() const;
+    void        reset();
+
+    bool        update(FrameContext &frame);
+    double      motion() const;
+    long long   executed() const;
+    long long   skipped() const;
+    void        resetCounters();
+
+private:
+    // The frames are compared at about 1 / SCALE of their width
+    static const int    SCALE = 8;
+
+    bool        m_enabled;
+    int         m_pixelThreshold;
+    double      m_changedFraction;
+    int         m_maxSkipped;
+    cv::Mat     m_reference;            // small grey image of the last detected frame
+    cv::Mat     m_difference;
+    int         m_skippedInRow;
+    double      m_motion;               // changed fraction of the last frame compared
+    long long   m_executed;
+    long long   m_skipped;
+};
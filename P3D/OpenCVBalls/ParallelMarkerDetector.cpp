@@ -0,0 +1,359 @@
+#include "ParallelMarkerDetector.h"
+#include <iostream>
+#include <algorithm>
+#include <opencv2\imgproc.hpp>
+#include "Dependencies\aruco\markerlabeler.h"
+
+namespace
+{
+    // Work item i of count, split evenly between chunks
+    cv::Range chunkRange(const int chunk, const int chunks, const int count)
+    {
+        return cv::Range(chunk * count / chunks, (chunk + 1) * count / chunks);
+    }
+
+    /*
+    * Thresholds a band of rows with one worker each. Every band is computed with a halo of
+    * rows above and below, so the local window sees the same pixels as on the whole image.
+    */
+    class ThresholdBody : public cv::ParallelLoopBody
+    {
+    public:
+        ThresholdBody(std::vector<aruco::MarkerDetector*> &workers, const cv::Mat &grey, cv::Mat &out,
+            const int method, const double param1, const double param2, const int halo)
+            : m_workers(workers), m_grey(grey), m_out(out), m_method(method), m_param1(param1), m_param2(param2), m_halo(halo)
+        {
+        }
+
+        void operator()(const cv::Range &bands) const
+        {
+            for (int band = bands.start; band < bands.end; band++) {
+                cv::Range rows = chunkRange(band, (int)m_workers.size(), m_grey.rows);
+                if (rows.size() == 0) continue;
+                cv::Range halo(std::max(rows.start - m_halo, 0), std::min(rows.end + m_halo, m_grey.rows));
+
+                cv::Mat thresholded;
+                m_workers[band]->thresHold(m_method, m_grey.rowRange(halo), thresholded, m_param1, m_param2);
+                cv::Mat target = m_out.rowRange(rows);
+                thresholded.rowRange(rows.start - halo.start, rows.end - halo.start).copyTo(target);
+            }
+        }
+
+    private:
+        std::vector<aruco::MarkerDetector*>&    m_workers;
+        const cv::Mat&                          m_grey;
+        cv::Mat&                                m_out;
+        const int                               m_method;
+        const double                            m_param1, m_param2;
+        const int                               m_halo;
+    };
+
+    class RectangleBody : public cv::ParallelLoopBody
+    {
+    public:
+        RectangleBody(std::vector<aruco::MarkerDetector*> &workers, const std::vector<cv::Mat> &thresholds,
+            std::vector<std::vector<std::vector<cv::Point2f> > > &candidates)
+            : m_workers(workers), m_thresholds(thresholds), m_candidates(candidates)
+        {
+        }
+
+        // A worker keeps buffers of its own, so each one takes a fixed share of the levels
+        void operator()(const cv::Range &chunks) const
+        {
+            for (int chunk = chunks.start; chunk < chunks.end; chunk++) {
+                cv::Range levels = chunkRange(chunk, (int)m_workers.size(), (int)m_thresholds.size());
+                for (int level = levels.start; level < levels.end; level++) {
+                    m_workers[chunk]->detectRectangles(m_thresholds[level], m_candidates[level]);
+                }
+            }
+        }
+
+    private:
+        std::vector<aruco::MarkerDetector*>&                    m_workers;
+        const std::vector<cv::Mat>&                             m_thresholds;
+        std::vector<std::vector<std::vector<cv::Point2f> > >&   m_candidates;
+    };
+
+    /*
+    * Warp, labelling and corner refinement of a contiguous share of the candidates per
+    * worker. Each result stays at its candidate's index.
+    */
+    class LabelBody : public cv::ParallelLoopBody
+    {
+    public:
+        LabelBody(std::vector<aruco::MarkerDetector*> &workers, cv::Mat &grey, std::vector<aruco::Marker> &candidates,
+            const aruco::MarkerDetector::Params &params, std::mutex &labelerMutex)
+            : m_workers(workers), m_grey(grey), m_candidates(candidates), m_params(params), m_labelerMutex(labelerMutex)
+        {
+        }
+
+        void operator()(const cv::Range &chunks) const
+        {
+            cv::Mat canonical;
+            for (int chunk = chunks.start; chunk < chunks.end; chunk++) {
+                aruco::MarkerDetector &worker = *m_workers[chunk];
+                cv::Ptr<aruco::MarkerLabeler> labeler = worker.getMarkerLabeler();
+                int warpSize = labeler->getBestInputSize() > 0 ? labeler->getBestInputSize() : m_params._markerWarpSize;
+
+                cv::Range range = chunkRange(chunk, (int)m_workers.size(), (int)m_candidates.size());
+                for (int i = range.start; i < range.end; i++) {
+                    aruco::Marker &candidate = m_candidates[i];
+                    int id, rotations;
+                    if (!worker.warp(m_grey, canonical, cv::Size(warpSize, warpSize), candidate)) continue;
+                    {
+                        std::lock_guard<std::mutex> lock(m_labelerMutex);
+                        if (!labeler->detect(canonical, id, rotations)) continue;
+                    }
+
+                    // Corner 0 is always the same corner of the printed marker
+                    candidate.id = id;
+                    std::rotate(candidate.begin(), candidate.begin() + 4 - rotations, candidate.end());
+
+                    if (m_params._cornerMethod != aruco::MarkerDetector::NONE) {
+                        cv::cornerSubPix(m_grey, (std::vector<cv::Point2f>&)candidate,
+                            cv::Size(m_params._subpix_wsize, m_params._subpix_wsize), cv::Size(-1, -1),
+                            cv::TermCriteria(cv::TermCriteria::MAX_ITER | cv::TermCriteria::EPS, 12, 0.005));
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<aruco::MarkerDetector*>&    m_workers;
+        cv::Mat&                                m_grey;
+        std::vector<aruco::Marker>&             m_candidates;
+        const aruco::MarkerDetector::Params&    m_params;
+        std::mutex&                             m_labelerMutex;
+    };
+
+    bool byId(const aruco::Marker &a, const aruco::Marker &b)
+    {
+        return a.id < b.id;
+    }
+}
+
+ParallelMarkerDetector::ParallelMarkerDetector(const int threads)
+    : m_threads(threads)
+{
+}
+
+ParallelMarkerDetector::~ParallelMarkerDetector()
+{
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        delete m_workers[i];
+    }
+}
+
+void ParallelMarkerDetector::setThreads(const int threads)
+{
+    m_threads = threads;
+}
+
+int ParallelMarkerDetector::threads() const
+{
+    return m_threads > 0 ? m_threads : std::max(cv::getNumThreads(), 1);
+}
+
+/*
+* One worker per thread, with the detector's parameters and the detector's own labeler.
+* A labeler cannot be read back or copied through its interface (a dictionary labeler
+* created by name would lose the error correction rate), so the workers share it.
+*/
+void ParallelMarkerDetector::prepareWorkers(aruco::MarkerDetector &detector, const int count)
+{
+    while ((int)m_workers.size() < count) {
+        m_workers.push_back(new aruco::MarkerDetector());
+    }
+    while ((int)m_workers.size() > count) {
+        delete m_workers.back();
+        m_workers.pop_back();
+    }
+
+    cv::Ptr<aruco::MarkerLabeler> labeler = detector.getMarkerLabeler();
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->setMarkerLabeler(labeler);
+        m_workers[i]->setParams(detector.getParams());
+    }
+}
+
+void ParallelMarkerDetector::threshold(const aruco::MarkerDetector::Params &params, const double param1, cv::Mat &out)
+{
+    out.create(m_grey.size(), CV_8UC1);
+
+    // Fixed and adaptive thresholds only look at a small neighbourhood; Canny does not
+    int halo = -1;
+    if (params._thresMethod == aruco::MarkerDetector::FIXED_THRES) halo = 0;
+    if (params._thresMethod == aruco::MarkerDetector::ADPT_THRES) halo = (int)param1 / 2 + 2;
+
+    if (halo < 0 || m_workers.size() == 1) {
+        m_workers[0]->thresHold(params._thresMethod, m_grey, out, param1, params._thresParam2);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, (int)m_workers.size()),
+        ThresholdBody(m_workers, m_grey, out, params._thresMethod, param1, params._thresParam2, halo));
+}
+
+/*
+* Candidates of every threshold level in level order. A candidate whose corners are all
+* close to those of one already taken (same square found at another level) is skipped.
+*/
+void ParallelMarkerDetector::collectCandidates()
+{
+    m_candidates.clear();
+    for (size_t level = 0; level < m_levelCandidates.size(); level++) {
+        const std::vector<std::vector<cv::Point2f> > &found = m_levelCandidates[level];
+        const size_t taken = m_candidates.size();
+
+        for (size_t i = 0; i < found.size(); i++) {
+            bool duplicate = false;
+            for (size_t j = 0; j < taken && !duplicate; j++) {
+                float tolerance = m_candidates[j].getPerimeter() * 0.025f, distance = 0;
+                for (int c = 0; c < 4; c++) {
+                    cv::Point2f d = found[i][c] - m_candidates[j][c];
+                    distance = std::max(distance, std::abs(d.x) + std::abs(d.y));
+                }
+                duplicate = distance < tolerance;
+            }
+            if (!duplicate) m_candidates.push_back(aruco::Marker(found[i]));
+        }
+    }
+}
+
+/*
+* Same contract as aruco::MarkerDetector::detect(image, markers): corners and ids, no pose.
+*/
+void ParallelMarkerDetector::detect(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers)
+{
+    markers.clear();
+    const aruco::MarkerDetector::Params params = detector.getParams();
+    prepareWorkers(detector, threads());
+
+    if (image.channels() == 3)
+        cv::cvtColor(image, m_grey, cv::COLOR_BGR2GRAY);
+    else
+        m_grey = image;
+
+    // Adaptive threshold window sizes of the levels: param1, param1 + 2, ..., param1 + 2 * range
+    const int levels = params._thresMethod == aruco::MarkerDetector::ADPT_THRES ? (int)params._thresParam1_range + 1 : 1;
+    m_thresholds.resize(levels);
+    m_levelCandidates.resize(levels);
+    for (int level = 0; level < levels; level++) {
+        threshold(params, params._thresParam1 + 2 * level, m_thresholds[level]);
+    }
+    cv::parallel_for_(cv::Range(0, (int)m_workers.size()), RectangleBody(m_workers, m_thresholds, m_levelCandidates));
+    collectCandidates();
+
+    cv::parallel_for_(cv::Range(0, (int)m_workers.size()), LabelBody(m_workers, m_grey, m_candidates, params, m_labelerMutex));
+
+    for (size_t i = 0; i < m_candidates.size(); i++) {
+        if (m_candidates[i].id != -1) markers.push_back(m_candidates[i]);
+    }
+
+    // By id, and of two markers with the same id the one with the larger perimeter
+    std::stable_sort(markers.begin(), markers.end(), byId);
+    size_t kept = 0;
+    for (size_t i = 0; i < markers.size(); i++) {
+        if (kept > 0 && markers[kept - 1].id == markers[i].id) {
+            if (markers[i].getPerimeter() > markers[kept - 1].getPerimeter()) markers[kept - 1] = markers[i];
+            continue;
+        }
+        markers[kept++] = markers[i];
+    }
+    markers.resize(kept);
+
+    // Corners too near the image border are not reliable
+    const float border = params._borderDistThres * std::max(image.cols, image.rows);
+    kept = 0;
+    for (size_t i = 0; i < markers.size(); i++) {
+        bool inside = true;
+        for (int c = 0; c < 4; c++) {
+            const cv::Point2f &p = markers[i][c];
+            inside = inside && p.x >= border && p.y >= border && p.x < image.cols - 1 - border && p.y < image.rows - 1 - border;
+        }
+        if (inside) markers[kept++] = markers[i];
+    }
+    markers.resize(kept);
+}
+
+/*
+* Times aruco::MarkerDetector::detect against this detector with 1, 2, 4 and all threads
+* on a frame with markerCount markers in a grid, and checks that they find the same ids
+* with every corner within a pixel of the library's (the refinement methods differ).
+* Returns false, printing MISMATCH, when any thread count does not.
+*/
+bool ParallelMarkerDetector::benchmark(const cv::Size &frameSize, const int markerCount, const int frames)
+{
+    const double CORNER_TOLERANCE = 1.0;
+
+    aruco::Dictionary dictionary = aruco::Dictionary::loadPredefined(aruco::Dictionary::ARUCO);
+
+    cv::Mat grey(frameSize, CV_8UC1), frame;
+    cv::randu(grey, cv::Scalar(90), cv::Scalar(170));
+    cv::GaussianBlur(grey, grey, cv::Size(5, 5), 2);
+
+    int columns = 1;
+    while (columns * columns * frameSize.height < markerCount * frameSize.width) columns++;
+    const int rows = (markerCount + columns - 1) / columns;
+    const int cell = std::min(frameSize.width / columns, frameSize.height / rows);
+    const int side = cell * 2 / 3;
+    for (int i = 0; i < markerCount; i++) {
+        cv::Mat image = dictionary.getMarkerImage_id(i * 5 + 2, 10, false), scaled;
+        cv::resize(image, scaled, cv::Size(side, side), 0, 0, cv::INTER_NEAREST);
+        cv::copyMakeBorder(scaled, scaled, side / 8, side / 8, side / 8, side / 8, cv::BORDER_CONSTANT, cv::Scalar(255));
+        cv::Rect place((i % columns) * cell + (cell - scaled.cols) / 2, (i / columns) * cell + (cell - scaled.rows) / 2,
+            scaled.cols, scaled.rows);
+        cv::Mat target = grey(place);
+        scaled.copyTo(target);
+    }
+    cv::GaussianBlur(grey, grey, cv::Size(3, 3), 0.8);
+    cv::cvtColor(grey, frame, cv::COLOR_GRAY2BGR);
+
+    aruco::MarkerDetector detector;
+    std::vector<aruco::Marker> reference, markers;
+
+    detector.detect(frame, reference);
+    int64 start = cv::getTickCount();
+    for (int i = 0; i < frames; i++) {
+        detector.detect(frame, reference);
+    }
+    double referenceTime = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+    std::cout << "Marker detection " << frameSize.width << "x" << frameSize.height << ", " << markerCount
+        << " markers: aruco " << referenceTime * 1000.0 << " ms (" << reference.size() << " found)";
+
+    bool same = true;
+    const int threadCounts[] = { 1, 2, 4, std::max(cv::getNumThreads(), 1) };
+    for (int t = 0; t < 4; t++) {
+        if (t == 3 && threadCounts[3] <= 4) break;
+
+        ParallelMarkerDetector parallel(threadCounts[t]);
+        parallel.detect(detector, frame, markers);
+        start = cv::getTickCount();
+        for (int i = 0; i < frames; i++) {
+            parallel.detect(detector, frame, markers);
+        }
+        double time = (cv::getTickCount() - start) / cv::getTickFrequency() / frames;
+
+        // Both lists are sorted by id, with one marker per id
+        int matched = 0;
+        double cornerError = 0;
+        for (size_t i = 0; i < reference.size(); i++) {
+            for (size_t j = 0; j < markers.size(); j++) {
+                if (markers[j].id != reference[i].id) continue;
+                matched++;
+                for (int c = 0; c < 4; c++) {
+                    cv::Point2f d = markers[j][c] - reference[i][c];
+                    cornerError = std::max(cornerError, (double)std::sqrt(d.dot(d)));
+                }
+            }
+        }
+        bool ok = matched == (int)reference.size() && markers.size() == reference.size() && cornerError <= CORNER_TOLERANCE;
+        same = same && ok;
+
+        std::cout << " | " << threadCounts[t] << " threads " << time * 1000.0 << " ms (" << referenceTime / time << "x, "
+            << matched << " of " << reference.size() << " matched, " << markers.size() - matched << " extra, corners within "
+            << cornerError << " px" << (ok ? ")" : ", MISMATCH)");
+    }
+    std::cout << std::endl;
+    return same;
+}
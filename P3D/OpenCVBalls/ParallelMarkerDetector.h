@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <mutex>
+#include <opencv2\core.hpp>
+#include "Dependencies\aruco\aruco.h"
+
+/*
+* aruco::MarkerDetector::detect, rebuilt from the detector's public stages so they can run
+* on several threads (the library is prebuilt without OpenMP):
+*
+* - the threshold is computed in bands of rows, with enough overlap for the local window
+*   that each band's rows are exactly those of the whole image, and each threshold level
+*   (thresParam1_range) is searched for rectangles on its own thread;
+* - the candidates are split between the threads for the warp to the canonical image, the
+*   labelling and the sub-pixel corner refinement.
+*
+* Each thread has its own copy of the detector, configured like the detector passed to
+* detect(), and labels with that detector's own labeler, so the dictionary and its error
+* correction are exactly the ones configured there. The labeler may keep buffers, so it
+* runs on one thread at a time; the warps before it run in parallel. Results are kept by
+* candidate index and then sorted by id, so the output does not depend on the number of
+* threads.
+*
+* Corners are refined with cornerSubPix: the LINES refinement needs the candidate's contour,
+* which the public rectangle search does not return. The ids and corners are therefore
+* checked against the library's by benchmark().
+*/
+class ParallelMarkerDetector
+{
+public:
+    ParallelMarkerDetector(const int threads = 0);
+    ~ParallelMarkerDetector();
+    ParallelMarkerDetector(const ParallelMarkerDetector&) = delete;
+    ParallelMarkerDetector& operator=(const ParallelMarkerDetector&) = delete;
+
+    void            setThreads(const int threads);
+    int             threads() const;
+
+    void            detect(aruco::MarkerDetector &detector, const cv::Mat &image, std::vector<aruco::Marker> &markers);
+
+    static bool     benchmark(const cv::Size &frameSize, const int markerCount, const int frames);
+
+private:
+    int                                 m_threads;
+    std::vector<aruco::MarkerDetector*> m_workers;
+    std::mutex                          m_labelerMutex;
+    cv::Mat                             m_grey;
+    std::vector<cv::Mat>                m_thresholds;
+    std::vector<std::vector<std::vector<cv::Point2f> > >  m_levelCandidates;
+    std::vector<aruco::Marker>          m_candidates;    // id -1 until labelled
+
+    void            prepareWorkers(aruco::MarkerDetector &detector, const int count);
+    void            threshold(const aruco::MarkerDetector::Params &params, const double param1, cv::Mat &out);
+    void            collectCandidates();
+};
@@ -0,0 +1,101 @@
+#include "ResultWriter.h"
+#include <iostream>
+#include <algorithm>
+
+const int ResultObject::MAX_VALUES;
+
+ResultWriter::ResultWriter()
+    : m_format(CSV), m_fieldCount(0)
+{
+}
+
+bool ResultWriter::parseFormat(const std::string &name, Format &format)
+{
+    if (name == "csv") {
+        format = CSV;
+        return true;
+    }
+    if (name == "binary") {
+        format = BINARY;
+        return true;
+    }
+    return false;
+}
+
+const char* ResultWriter::extension(const Format format)
+{
+    return format == CSV ? ".csv" : ".bin";
+}
+
+/*
+* fields are the names of an object's values, at most ResultObject::MAX_VALUES.
+*/
+bool ResultWriter::open(const std::string &path, const Format format, const std::vector<std::string> &fields)
+{
+    close();
+    m_file.open(path.c_str(), format == CSV ? std::ios::out : std::ios::out | std::ios::binary);
+    if (!m_file.is_open()) {
+        std::cerr << "Error opening the results file " << path << "." << std::endl;
+        return false;
+    }
+
+    m_format = format;
+    m_fieldCount = std::min((int)fields.size(), ResultObject::MAX_VALUES);
+
+    if (m_format == CSV) {
+        m_file << "frame,timestamp,objects,id";
+        for (int f = 0; f < m_fieldCount; f++) {
+            m_file << "," << fields[f];
+        }
+        m_file << "\n";
+    }
+    else {
+        const int version = VERSION;
+        m_file.write("OCVR", 4);
+        m_file.write((const char*)&version, sizeof(version));
+        m_file.write((const char*)&m_fieldCount, sizeof(m_fieldCount));
+        for (int f = 0; f < m_fieldCount; f++) {
+            m_file.write(fields[f].c_str(), fields[f].size() + 1);
+        }
+    }
+    return true;
+}
+
+void ResultWriter::close()
+{
+    if (m_file.is_open()) m_file.close();
+}
+
+bool ResultWriter::isOpen() const
+{
+    return m_file.is_open();
+}
+
+void ResultWriter::write(const long long frame, const double timestamp, const std::vector<ResultObject> &objects)
+{
+    if (!m_file.is_open()) return;
+
+    if (m_format == CSV) {
+        if (objects.empty()) {
+            m_file << frame << "," << timestamp << ",0," << std::string(m_fieldCount, ',') << "\n";
+            return;
+        }
+        for (size_t i = 0; i < objects.size(); i++) {
+            m_file << frame << "," << timestamp << "," << objects.size() << "," << objects[i].id;
+            for (int f = 0; f < m_fieldCount; f++) {
+                m_file << "," << objects[i].values[f];
+            }
+            m_file << "\n";
+        }
+        return;
+    }
+
+    const int count = (int)objects.size();
+    m_file.write((const char*)&frame, sizeof(frame));
+    m_file.write((const char*)&timestamp, sizeof(timestamp));
+    m_file.write((const char*)&count, sizeof(count));
+    for (size_t i = 0; i < objects.size(); i++) {
+        m_file.write((const char*)&objects[i].id, sizeof(objects[i].id));
+        m_file.write((const char*)objects[i].values, m_fieldCount * sizeof(float));
+    }
+}
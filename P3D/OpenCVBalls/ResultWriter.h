@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+// One tracked object of a frame: a ball, a face or a marker
+struct ResultObject
+{
+    static const int    MAX_VALUES = 6;
+
+    int     id;
+    float   values[MAX_VALUES];     // as many as the writer has fields
+};
+
+/*
+* Writes the objects tracked in each frame to a file, as CSV or binary.
+*
+* CSV has a header line and one line per object: frame, timestamp, objects in the frame,
+* id and the fields. A frame without objects still gets a line, with 0 objects and the
+* other columns empty.
+*
+* Binary starts with "OCVR", the version (int32, 1) and the number of fields (int32),
+* followed by each field name ending in '\0'. Then, per frame: frame (int64), timestamp
+* (double), object count (int32) and, per object, the id (int32) and the fields (float).
+* Everything is in the machine's byte order.
+*/
+class ResultWriter
+{
+public:
+    enum Format
+    {
+        CSV,
+        BINARY
+    };
+
+    ResultWriter();
+
+    static bool         parseFormat(const std::string &name, Format &format);
+    static const char*  extension(const Format format);
+
+    bool                open(const std::string &path, const Format format, const std::vector<std::string> &fields);
+    void                close();
+    bool                isOpen() const;
+    void                write(const long long frame, const double timestamp, const std::vector<ResultObject> &objects);
+
+private:
+    static const int    VERSION = 1;
+
+    std::ofstream       m_file;
+    Format              m_format;
+    int                 m_fieldCount;
+};
@@ -0,0 +1,107 @@
+#include "SearchWindow.h"
+#include <cmath>
+#include <algorithm>
+
+SearchWindow::SearchWindow()
+    : m_enabled(true), m_fullSearchInterval(0), m_lastFullSearch(0)
+{
+    reset();
+}
+
+void SearchWindow::setEnabled(const bool enabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_enabled = enabled;
+}
+
+bool SearchWindow::enabled() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_enabled;
+}
+
+void SearchWindow::reset()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tracking = false;
+    m_velocity = cv::Point2f(0, 0);
+    m_radius = 0;
+    m_sequence = 0;
+    m_misses = 0;
+}
+
+void SearchWindow::setFullSearchInterval(const int frames)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_fullSearchInterval = frames;
+}
+
+/*
+* Window to process for frame number sequence: the whole frame while searching,
+* otherwise a square around the predicted position of the ball.
+*/
+cv::Rect SearchWindow::next(const cv::Size &frameSize, const long long sequence)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    cv::Rect frame(cv::Point(0, 0), frameSize);
+    if (!m_enabled || !m_tracking ||
+        (m_fullSearchInterval > 0 && sequence - m_lastFullSearch >= m_fullSearchInterval)) {
+        m_lastFullSearch = sequence;
+        return frame;
+    }
+
+    float frames = (float)std::max(sequence - m_sequence, 1LL);
+    cv::Point2f predicted = m_center + m_velocity * frames;
+    float speed = std::sqrt(m_velocity.x * m_velocity.x + m_velocity.y * m_velocity.y);
+
+    // Room for the ball, for an error of up to its speed per frame, and more after each miss
+    int halfSize = (int)((m_radius + speed * frames) * (1 + m_misses)) + MARGIN;
+    halfSize = std::max(halfSize, MIN_HALF_SIZE);
+
+    cv::Rect window((int)predicted.x - halfSize, (int)predicted.y - halfSize, 2 * halfSize, 2 * halfSize);
+    window &= frame;
+    if (window.area() > 0) return window;
+
+    m_lastFullSearch = sequence;
+    return frame;
+}
+
+/*
+* Result of the frame that was processed in window. The detection is in frame coordinates.
+*/
+void SearchWindow::update(const BlobDetection &detection, const int blobCount, const cv::Rect &window,
+    const cv::Size &frameSize, const long long sequence)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A window around one ball would lose the others
+    if (blobCount > 1) {
+        m_tracking = false;
+        m_velocity = cv::Point2f(0, 0);
+        m_misses = 0;
+        return;
+    }
+
+    if (detection.found) {
+        if (m_tracking && sequence > m_sequence) {
+            cv::Point2f measured = (detection.center - m_center) * (1.0f / (sequence - m_sequence));
+            m_velocity = m_velocity * 0.5f + measured * 0.5f;
+        }
+        else {
+            m_velocity = cv::Point2f(0, 0);
+        }
+        m_center = detection.center;
+        m_radius = detection.radius;
+        m_sequence = sequence;
+        m_misses = 0;
+        m_tracking = true;
+        return;
+    }
+
+    // Nothing in the whole frame: the ball is gone, no need to wait for more misses
+    if (window == cv::Rect(cv::Point(0, 0), frameSize) || ++m_misses >= MAX_MISSES) {
+        m_tracking = false;
+        m_velocity = cv::Point2f(0, 0);
+        m_misses = 0;
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <mutex>
+#include <opencv2\core.hpp>
+#include "ColorTracker.h"
+
+/*
+* Region of the frame where the colour tracker looks for the ball. Once the ball is found
+* its next position is predicted from the last detections (constant velocity) and only a
+* window around it is processed; the window grows with the ball's radius, its speed and
+* the number of frames since it was last seen. After a few frames without a detection
+* the whole frame is searched again.
+*
+* next() and update() are called from different pipeline stages, so frames can be
+* windowed before the detection of the previous ones is known: predictions are made in
+* frame numbers, not per call.
+*
+* While several balls are visible the whole frame is searched, and with a full search
+* interval set the whole frame is also searched every that many frames, to find new ones.
+*/
+class SearchWindow
+{
+public:
+    SearchWindow();
+
+    void        setEnabled(const bool enabled);
+    bool        enabled() const;
+    void        reset();
+    void        setFullSearchInterval(const int frames);
+
+    cv::Rect    next(const cv::Size &frameSize, const long long sequence);
+    void        update(const BlobDetection &detection, const int blobCount, const cv::Rect &window,
+                    const cv::Size &frameSize, const long long sequence);
+
+private:
+    static const int    MAX_MISSES = 3;
+    static const int    MARGIN = 16;            // pixels added on each side of the predicted ball
+    static const int    MIN_HALF_SIZE = 32;
+
+    mutable std::mutex  m_mutex;
+    bool                m_enabled;
+    bool                m_tracking;
+    cv::Point2f         m_center;
+    cv::Point2f         m_velocity;             // pixels per frame
+    float               m_radius;
+    long long           m_sequence;             // frame of the last detection
+    int                 m_misses;
+    int                 m_fullSearchInterval;   // 0: only when the ball is lost
+    long long           m_lastFullSearch;
+};
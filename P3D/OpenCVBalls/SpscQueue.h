@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+
+/*
+* Bounded lock-free queue for exactly one producer thread and one consumer thread.
+* push() fails instead of blocking when the queue is full, pop() when it is empty.
+*/
+template<typename T>
+class SpscQueue
+{
+public:
+    SpscQueue(const size_t capacity)
+        : m_head(0), m_tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        m_items.resize(size);
+        m_mask = size - 1;
+    }
+
+    bool push(const T &item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_mask) return false;
+
+        m_items[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+        item = m_items[head & m_mask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t size() const
+    {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+private:
+    std::vector<T>      m_items;
+    size_t              m_mask;
+
+    // Head and tail on separate cache lines, so producer and consumer do not share one
+    std::atomic<size_t> m_head;
+    char                m_padding[64];
+    std::atomic<size_t> m_tail;
+};
@@ -0,0 +1,330 @@
+#include "TextureAtlas.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include "tga.h"
+
+TextureAtlas::TextureAtlas(const int pageSize, const int padding)
+{
+    m_pageSize = pageSize;
+    m_padding = std::max(padding, 1);
+
+    // Mip levels are limited so that the gutter is still at least one texel wide
+    // in the smallest level, otherwise neighbouring entries bleed into each other
+    m_maxLevel = 0;
+    while ((2 << m_maxLevel) <= m_padding)
+        m_maxLevel++;
+}
+
+TextureAtlas::~TextureAtlas()
+{
+    for (auto &image : m_pending) {
+        delete[] image.pixels;
+    }
+    if (!m_pages.empty()) {
+        glDeleteTextures((GLsizei)m_pages.size(), &m_pages[0]);
+    }
+}
+
+int TextureAtlas::add(const std::string &name, const std::string &tgaFilePath)
+{
+    std::vector<char> writable(tgaFilePath.begin(), tgaFilePath.end());
+    writable.push_back('\0');
+
+    tgaInfo *im = tgaLoad(&writable[0]);
+    if (im == NULL || im->status != TGA_OK) {
+        std::cerr << "Error loading " << tgaFilePath << " into the texture atlas." << std::endl;
+        if (im != NULL) free(im);
+        return -1;
+    }
+
+    // Everything is stored as RGBA, images without alpha become opaque
+    PendingImage image;
+    image.name = name;
+    image.path = tgaFilePath;
+    image.width = im->width;
+    image.height = im->height;
+    image.components = im->pixelDepth / 8;
+    image.pixels = new unsigned char[image.width * image.height * 4];
+    for (int i = 0; i < image.width * image.height; i++) {
+        const unsigned char *src = &im->imageData[i * image.components];
+        unsigned char *dst = &image.pixels[i * 4];
+        if (image.components >= 3) {
+            dst[0] = src[0];
+            dst[1] = src[1];
+            dst[2] = src[2];
+            dst[3] = image.components == 4 ? src[3] : 255;
+        }
+        else {
+            dst[0] = dst[1] = dst[2] = src[0];
+            dst[3] = 255;
+        }
+    }
+    tgaDestroy(im);
+
+    m_pending.push_back(image);
+    m_names[name] = (int)m_pending.size() - 1;
+
+    return (int)m_pending.size() - 1;
+}
+
+int TextureAtlas::build()
+{
+    const int alignment = 1 << m_maxLevel;
+    int packed = 0;
+
+    m_entries.resize(m_pending.size());
+
+    // Tallest images first, the skyline wastes less space this way
+    std::vector<int> order(m_pending.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = (int)i;
+    std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+        return m_pending[a].height > m_pending[b].height;
+    });
+
+    std::vector<unsigned char*> pagePixels;
+    for (auto index : order) {
+        const PendingImage &image = m_pending[index];
+        AtlasEntry &entry = m_entries[index];
+
+        // Reserve the gutter on every side, rounded so every entry starts on a texel
+        // that is still a whole texel in the last mip level
+        int width = (image.width + 2 * m_padding + alignment - 1) / alignment * alignment;
+        int height = (image.height + 2 * m_padding + alignment - 1) / alignment * alignment;
+        entry.page = -1;
+
+        if (width > m_pageSize || height > m_pageSize) {
+            std::cerr << image.path << " is bigger than an atlas page (" << m_pageSize << ")." << std::endl;
+            continue;
+        }
+
+        int x = 0, y = 0;
+        for (int page = 0; page < (int)m_skylines.size() && entry.page < 0; page++) {
+            if (packInPage(page, width, height, x, y))
+                entry.page = page;
+        }
+        if (entry.page < 0) {
+            SkylineNode node = { 0, 0, m_pageSize };
+            m_skylines.push_back(std::vector<SkylineNode>(1, node));
+            pagePixels.push_back(new unsigned char[m_pageSize * m_pageSize * 4]());
+            entry.page = (int)m_skylines.size() - 1;
+            packInPage(entry.page, width, height, x, y);
+        }
+
+        entry.x = x + m_padding;
+        entry.y = y + m_padding;
+        entry.width = image.width;
+        entry.height = image.height;
+        entry.u0 = (float)entry.x / m_pageSize;
+        entry.v0 = (float)entry.y / m_pageSize;
+        entry.u1 = (float)(entry.x + entry.width) / m_pageSize;
+        entry.v1 = (float)(entry.y + entry.height) / m_pageSize;
+
+        blit(pagePixels[entry.page], image, entry.x, entry.y);
+        packed++;
+    }
+
+    // Upload every page with its mip chain
+    m_pages.resize(pagePixels.size());
+    if (!m_pages.empty()) {
+        glGenTextures((GLsizei)m_pages.size(), &m_pages[0]);
+    }
+    for (size_t page = 0; page < pagePixels.size(); page++) {
+        upload(m_pages[page], pagePixels[page]);
+        delete[] pagePixels[page];
+    }
+
+    for (auto &image : m_pending) {
+        delete[] image.pixels;
+        image.pixels = NULL;
+    }
+
+    return packed;
+}
+
+int TextureAtlas::find(const std::string &name) const
+{
+    std::map<std::string, int>::const_iterator it = m_names.find(name);
+    return it == m_names.end() ? -1 : it->second;
+}
+
+const AtlasEntry& TextureAtlas::entry(const int index) const
+{
+    return m_entries[index];
+}
+
+int TextureAtlas::entryCount() const
+{
+    return (int)m_entries.size();
+}
+
+int TextureAtlas::pageCount() const
+{
+    return (int)m_pages.size();
+}
+
+GLuint TextureAtlas::pageTexture(const int page) const
+{
+    return m_pages[page];
+}
+
+/*
+* Binds the page of an entry, skipping the bind when that page is already bound.
+* Call unbind() once the atlas is no longer the last texture bound.
+*/
+void TextureAtlas::bind(const int index)
+{
+    int page = m_entries[index].page;
+    if (page != m_boundPage) {
+        glBindTexture(GL_TEXTURE_2D, m_pages[page]);
+        m_boundPage = page;
+    }
+}
+
+void TextureAtlas::unbind()
+{
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_boundPage = -1;
+}
+
+void TextureAtlas::drawQuad(const int index, const float halfWidth, const float halfHeight)
+{
+    if (index < 0 || m_entries[index].page < 0) return;
+    const AtlasEntry &e = m_entries[index];
+
+    bind(index);
+
+    glBegin(GL_QUADS);
+    glTexCoord2f(e.u0, e.v0);
+    glVertex3f(-halfWidth, -halfHeight, 0.0f);
+    glTexCoord2f(e.u1, e.v0);
+    glVertex3f(halfWidth, -halfHeight, 0.0f);
+    glTexCoord2f(e.u1, e.v1);
+    glVertex3f(halfWidth, halfHeight, 0.0f);
+    glTexCoord2f(e.u0, e.v1);
+    glVertex3f(-halfWidth, halfHeight, 0.0f);
+    glEnd();
+}
+
+bool TextureAtlas::packInPage(const int page, const int width, const int height, int &x, int &y)
+{
+    std::vector<SkylineNode> &skyline = m_skylines[page];
+    int bestIndex = -1, bestTop = m_pageSize + 1, bestWaste = m_pageSize + 1;
+
+    // Bottom-left rule: lowest resulting top edge, then the narrowest node
+    for (int i = 0; i < (int)skyline.size(); i++) {
+        int fitY = skylineFit(skyline, i, width, height);
+        if (fitY < 0) continue;
+
+        if (fitY + height < bestTop || (fitY + height == bestTop && skyline[i].width < bestWaste)) {
+            bestIndex = i;
+            bestTop = fitY + height;
+            bestWaste = skyline[i].width;
+            x = skyline[i].x;
+            y = fitY;
+        }
+    }
+
+    if (bestIndex < 0) return false;
+
+    skylineInsert(skyline, bestIndex, x, y, width, height);
+    return true;
+}
+
+/*
+* Height at which a width x height rectangle rests when placed on node index,
+* or -1 if it does not fit in the page.
+*/
+int TextureAtlas::skylineFit(const std::vector<SkylineNode> &skyline, const int index, const int width, const int height) const
+{
+    int x = skyline[index].x;
+    if (x + width > m_pageSize) return -1;
+
+    int y = 0;
+    int remaining = width;
+    for (int i = index; remaining > 0; i++) {
+        if (i >= (int)skyline.size()) return -1;
+        y = std::max(y, skyline[i].y);
+        if (y + height > m_pageSize) return -1;
+        remaining -= skyline[i].width;
+    }
+    return y;
+}
+
+void TextureAtlas::skylineInsert(std::vector<SkylineNode> &skyline, const int index, const int x, const int y, const int width, const int height)
+{
+    SkylineNode node = { x, y + height, width };
+    skyline.insert(skyline.begin() + index, node);
+
+    // Shrink or remove the nodes now covered by the new one
+    for (size_t i = index + 1; i < skyline.size(); i++) {
+        int covered = skyline[i - 1].x + skyline[i - 1].width - skyline[i].x;
+        if (covered <= 0) break;
+
+        skyline[i].x += covered;
+        skyline[i].width -= covered;
+        if (skyline[i].width > 0) break;
+
+        skyline.erase(skyline.begin() + i);
+        i--;
+    }
+
+    // Merge neighbours at the same height
+    for (size_t i = 0; i + 1 < skyline.size(); i++) {
+        if (skyline[i].y == skyline[i + 1].y) {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase(skyline.begin() + i + 1);
+            i--;
+        }
+    }
+}
+
+/*
+* Copies the image and extrudes its border pixels into the gutter, so linear filtering
+* and the smaller mip levels sample the entry's own edge instead of its neighbours.
+*/
+void TextureAtlas::blit(unsigned char *page, const PendingImage &image, const int x, const int y) const
+{
+    for (int row = -m_padding; row < image.height + m_padding; row++) {
+        int srcRow = std::min(std::max(row, 0), image.height - 1);
+        unsigned char *dst = &page[((y + row) * m_pageSize + x - m_padding) * 4];
+        const unsigned char *src = &image.pixels[srcRow * image.width * 4];
+
+        for (int col = -m_padding; col < 0; col++, dst += 4)
+            memcpy(dst, src, 4);
+        memcpy(dst, src, image.width * 4);
+        dst += image.width * 4;
+        for (int col = 0; col < m_padding; col++, dst += 4)
+            memcpy(dst, &src[(image.width - 1) * 4], 4);
+    }
+}
+
+void TextureAtlas::upload(const GLuint texture, unsigned char *page) const
+{
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_maxLevel);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_pageSize, m_pageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, page);
+
+    // Box filtered mip chain, computed in place
+    int size = m_pageSize;
+    for (int level = 1; level <= m_maxLevel && size > 1; level++) {
+        int half = size / 2;
+        for (int y = 0; y < half; y++) {
+            for (int x = 0; x < half; x++) {
+                const unsigned char *a = &page[((2 * y) * size + 2 * x) * 4];
+                const unsigned char *b = a + size * 4;
+                unsigned char *dst = &page[(y * half + x) * 4];
+                for (int c = 0; c < 4; c++)
+                    dst[c] = (unsigned char)((a[c] + a[c + 4] + b[c] + b[c + 4] + 2) / 4);
+            }
+        }
+        size = half;
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, page);
+    }
+}
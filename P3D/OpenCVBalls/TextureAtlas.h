@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include "Dependencies\glew\glew.h"
+
+/*
+* Packs many small TGA textures (face masks, decals) into a few atlas pages so they can
+* be drawn with one texture bind per page instead of one per object.
+*/
+struct AtlasEntry
+{
+    int     page;
+    int     x, y, width, height;    // texel rectangle inside the page, without the gutter
+    float   u0, v0, u1, v1;         // the same rectangle in texture coordinates
+};
+
+class TextureAtlas
+{
+public:
+    TextureAtlas(const int pageSize = 2048, const int padding = 8);
+    ~TextureAtlas();
+
+    int                     add(const std::string &name, const std::string &tgaFilePath);
+    int                     build();
+    int                     find(const std::string &name) const;
+    const AtlasEntry&       entry(const int index) const;
+    int                     entryCount() const;
+    int                     pageCount() const;
+    GLuint                  pageTexture(const int page) const;
+    void                    bind(const int index);
+    void                    unbind();
+    void                    drawQuad(const int index, const float halfWidth = 1.0f, const float halfHeight = 1.0f);
+
+private:
+    struct SkylineNode
+    {
+        int x, y, width;
+    };
+
+    struct PendingImage
+    {
+        std::string     name;
+        std::string     path;
+        int             width, height, components;
+        unsigned char*  pixels;
+    };
+
+    int                         m_pageSize;
+    int                         m_padding;
+    int                         m_maxLevel;
+    std::vector<PendingImage>   m_pending;
+    std::vector<AtlasEntry>     m_entries;
+    std::map<std::string, int>  m_names;
+    std::vector<GLuint>         m_pages;
+    std::vector<std::vector<SkylineNode> > m_skylines;
+    int                         m_boundPage = -1;
+
+    bool        packInPage(const int page, const int width, const int height, int &x, int &y);
+    int         skylineFit(const std::vector<SkylineNode> &skyline, const int index, const int width, const int height) const;
+    void        skylineInsert(std::vector<SkylineNode> &skyline, const int index, const int x, const int y, const int width, const int height);
+    void        blit(unsigned char *page, const PendingImage &image, const int x, const int y) const;
+    void        upload(const GLuint texture, unsigned char *page) const;
+};
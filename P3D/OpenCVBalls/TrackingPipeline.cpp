@@ -0,0 +1,265 @@
+#include "TrackingPipeline.h"
+#include <chrono>
+#include <algorithm>
+#include <opencv2\imgproc.hpp>
+
+TrackingPipeline::TrackingPipeline(const int depth)
+    : m_running(false), m_maxBlobs(1)
+{
+    for (int i = 0; i < std::max(depth, 1); i++) {
+        m_frames.push_back(new PipelineFrame());
+    }
+    m_freeFrames = m_frames;
+
+    // Every queue can hold all the frames, so a stage never waits to hand one on
+    for (int i = 0; i <= STAGES; i++) {
+        m_queues.push_back(new SpscQueue<PipelineFrame*>(m_frames.size()));
+    }
+    for (int i = 0; i < STAGES; i++) {
+        m_stageTicks[i] = 0;
+        m_stageFrames[i] = 0;
+    }
+
+    m_mog = new cv::BackgroundSubtractorMOG();
+}
+
+TrackingPipeline::~TrackingPipeline()
+{
+    stop();
+
+    for (auto queue : m_queues) {
+        delete queue;
+    }
+    for (auto frame : m_frames) {
+        delete frame;
+    }
+}
+
+void TrackingPipeline::start()
+{
+    if (m_running) return;
+
+    m_running = true;
+    for (int i = 0; i < STAGES; i++) {
+        m_threads[i] = std::thread(&TrackingPipeline::stageLoop, this, i);
+    }
+}
+
+void TrackingPipeline::stop()
+{
+    if (!m_running) return;
+
+    m_running = false;
+    for (int i = 0; i < STAGES; i++) {
+        m_threads[i].join();
+    }
+}
+
+/*
+* Copies the frame into the pipeline. Returns false (and counts a dropped frame) when
+* all the frames are still being processed or waiting to be picked up.
+*/
+bool TrackingPipeline::submit(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range)
+{
+    PipelineFrame *frame = acquire(bgr, captureTicks, range);
+    if (frame == NULL) return false;
+
+    m_queues[0]->push(frame);
+    return true;
+}
+
+/*
+* Oldest finished frame, or NULL if none is ready. Hand it back with release().
+*/
+PipelineFrame* TrackingPipeline::poll()
+{
+    PipelineFrame *frame = NULL;
+    if (!m_queues[STAGES]->pop(frame)) return NULL;
+
+    finish(*frame);
+    return frame;
+}
+
+/*
+* Runs the frame through every stage on the calling thread and returns it finished, as
+* poll() would; hand it back with release(). For a caller that needs the result of every
+* frame before the next one (e.g. a headless replay), with the pipeline not started:
+* returns NULL while it runs, or when all the frames are still held.
+*/
+PipelineFrame* TrackingPipeline::process(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range)
+{
+    if (m_running) return NULL;
+
+    PipelineFrame *frame = acquire(bgr, captureTicks, range);
+    if (frame == NULL) return NULL;
+
+    for (int stage = 0; stage < STAGES; stage++) {
+        int64 start = cv::getTickCount();
+        runStage(stage, *frame);
+        m_stageTicks[stage] += cv::getTickCount() - start;
+        m_stageFrames[stage]++;
+    }
+
+    finish(*frame);
+    return frame;
+}
+
+void TrackingPipeline::release(PipelineFrame *frame)
+{
+    m_freeFrames.push_back(frame);
+}
+
+StageTimings TrackingPipeline::timings()
+{
+    StageTimings timings;
+    double *stageTimes[STAGES] = { &timings.threshold, &timings.background, &timings.contours };
+
+    for (int i = 0; i < STAGES; i++) {
+        long long ticks = m_stageTicks[i].exchange(0);
+        long long frames = m_stageFrames[i].exchange(0);
+        *stageTimes[i] = frames > 0 ? ticks / cv::getTickFrequency() / frames : 0;
+    }
+    timings.latency = m_finished > 0 ? m_latency / m_finished : 0;
+    timings.windowArea = m_finished > 0 ? m_windowArea / m_finished : 0;
+    timings.frames = m_finished;
+    timings.dropped = m_dropped;
+
+    m_latency = 0;
+    m_windowArea = 0;
+    m_finished = 0;
+    m_dropped = 0;
+
+    return timings;
+}
+
+SearchWindow& TrackingPipeline::searchWindow()
+{
+    return m_searchWindow;
+}
+
+/*
+* With more than one blob, the search window also looks at the whole frame every few
+* frames, or new balls would never be seen while it follows the first one.
+*/
+void TrackingPipeline::setMaxBlobs(const int maxBlobs)
+{
+    m_maxBlobs = std::max(maxBlobs, 1);
+    m_searchWindow.setFullSearchInterval(maxBlobs > 1 ? 15 : 0);
+}
+
+int TrackingPipeline::maxBlobs() const
+{
+    return m_maxBlobs;
+}
+
+/*
+* A free frame with a copy of bgr, or NULL (counting a dropped frame) if there is none.
+*/
+PipelineFrame* TrackingPipeline::acquire(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range)
+{
+    if (m_freeFrames.empty()) {
+        m_dropped++;
+        return NULL;
+    }
+
+    PipelineFrame *frame = m_freeFrames.back();
+    m_freeFrames.pop_back();
+
+    bgr.copyTo(frame->bgr);
+    frame->range = range;
+    frame->captureTicks = captureTicks;
+    frame->sequence = m_submitted++;
+    return frame;
+}
+
+void TrackingPipeline::finish(const PipelineFrame &frame)
+{
+    m_latency += (cv::getTickCount() - frame.captureTicks) / cv::getTickFrequency();
+    m_windowArea += (double)frame.window.area() / frame.bgr.total();
+    m_finished++;
+}
+
+void TrackingPipeline::stageLoop(const int stage)
+{
+    int idle = 0;
+
+    while (m_running) {
+        PipelineFrame *frame;
+        if (!m_queues[stage]->pop(frame)) {
+            // Spin briefly for the next frame, then stop burning the core
+            if (++idle < 100)
+                std::this_thread::yield();
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        idle = 0;
+
+        int64 start = cv::getTickCount();
+        runStage(stage, *frame);
+        m_stageTicks[stage] += cv::getTickCount() - start;
+        m_stageFrames[stage]++;
+
+        m_queues[stage + 1]->push(frame);
+    }
+}
+
+/*
+* The masks are allocated at full frame size and each stage works on the window's part of
+* them, so a changing window does not reallocate anything.
+*/
+void TrackingPipeline::runStage(const int stage, PipelineFrame &frame)
+{
+    const cv::Size size = frame.bgr.size();
+    const bool wholeFrame = frame.window == cv::Rect(cv::Point(0, 0), size);
+
+    switch (stage) {
+    case 0: {
+        frame.window = m_searchWindow.next(size, frame.sequence);
+        frame.mask.create(size, CV_8UC1);
+        cv::Mat mask = frame.mask(frame.window);
+        m_tracker.setRange(frame.range);
+        m_tracker.filterBgr(frame.bgr(frame.window), mask);
+        break;
+    }
+    case 1: {
+        frame.blurred.create(size, CV_8UC1);
+        cv::Mat blurred = frame.blurred(frame.window);
+        if (wholeFrame) {
+            // The background model depends on the previous frames, so this stage must see them in order
+            m_mog->operator()(frame.mask, frame.foreground);
+            cv::GaussianBlur(frame.foreground, blurred, cv::Size(9, 9), 4, 4);
+            cv::flip(frame.blurred, frame.control, 1);
+        }
+        else {
+            // Isolated: the mask outside the window holds older frames
+            cv::GaussianBlur(frame.mask(frame.window), blurred, cv::Size(9, 9), 4, 4,
+                cv::BORDER_REFLECT_101 | cv::BORDER_ISOLATED);
+            cv::Rect mirrored(size.width - frame.window.x - frame.window.width, frame.window.y,
+                frame.window.width, frame.window.height);
+            frame.control.create(size, CV_8UC1);
+            frame.control.setTo(0);
+            cv::Mat control = frame.control(mirrored);
+            cv::flip(blurred, control, 1);
+            cv::rectangle(frame.control, mirrored, cv::Scalar(128), 1);
+        }
+        break;
+    }
+    case 2: {
+        cv::Mat blurred = frame.blurred(frame.window);
+        m_tracker.detectAll(blurred, frame.blobs, m_maxBlobs);
+        for (size_t i = 0; i < frame.blobs.size(); i++) {
+            frame.blobs[i].center += cv::Point2f((float)frame.window.x, (float)frame.window.y);
+        }
+        if (frame.blobs.empty()) {
+            frame.detection.found = false;
+            frame.detection.radius = 0;
+        }
+        else {
+            frame.detection = frame.blobs[0];
+        }
+        m_searchWindow.update(frame.detection, (int)frame.blobs.size(), frame.window, size, frame.sequence);
+        break;
+    }
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <opencv2\core.hpp>
+#include <opencv2\video\background_segm.hpp>
+#include "ColorTracker.h"
+#include "SpscQueue.h"
+#include "SearchWindow.h"
+
+/*
+* One frame travelling through the pipeline, with the buffers each stage writes into.
+* Frames are allocated once and recycled.
+*/
+struct PipelineFrame
+{
+    cv::Mat         bgr;
+    cv::Mat         mask;
+    cv::Mat         foreground;
+    cv::Mat         blurred;
+    cv::Mat         control;        // the blurred mask, mirrored for the Control window
+    ColorRange      range;
+    int64           captureTicks;
+    long long       sequence;
+    cv::Rect        window;         // part of the frame that was processed
+    BlobDetection   detection;     // the largest blob
+    std::vector<BlobDetection> blobs;   // up to maxBlobs(), largest first
+};
+
+/*
+* Average time spent per frame in each stage, and from capture to the result being
+* picked up, over the frames finished since the previous call to timings().
+*/
+struct StageTimings
+{
+    double      threshold;          // colour filter (lookup table, or cvtColor + HSV filter)
+    double      background;         // MOG + GaussianBlur + flip
+    double      contours;           // blob detection
+    double      latency;
+    double      windowArea;         // processed fraction of the frame
+    long long   frames;
+    long long   dropped;
+};
+
+/*
+* Runs the colour tracking of modes 1 and 2 as a pipeline, each stage on its own thread
+* and connected to the next by a single producer / single consumer queue. While frame N
+* is in contour analysis, frame N+1 is being thresholded and frame N-1 is being rendered.
+* The number of frames in flight is fixed, so latency stays bounded: when every frame is
+* busy, submit() drops the new one. Without start(), process() runs the stages of one
+* frame on the caller's thread instead.
+*
+* Once the ball is found, each frame is only processed inside the SearchWindow around its
+* predicted position. The background model needs every pixel of every frame, so it only
+* runs while the whole frame is searched; inside the window the colour mask is used as is.
+*/
+class TrackingPipeline
+{
+public:
+    TrackingPipeline(const int depth = 4);
+    ~TrackingPipeline();
+
+    void            start();
+    void            stop();
+    bool            submit(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range);
+    PipelineFrame*  poll();
+    PipelineFrame*  process(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range);
+    void            release(PipelineFrame *frame);
+    StageTimings    timings();
+    SearchWindow&   searchWindow();
+    void            setMaxBlobs(const int maxBlobs);
+    int             maxBlobs() const;
+
+private:
+    static const int                    STAGES = 3;
+
+    std::vector<PipelineFrame*>         m_frames;
+    std::vector<PipelineFrame*>         m_freeFrames;
+    std::vector<SpscQueue<PipelineFrame*>*> m_queues;   // input of each stage, the last one is the output
+    std::thread                         m_threads[STAGES];
+    std::atomic<bool>                   m_running;
+
+    ColorTracker                        m_tracker;
+    SearchWindow                        m_searchWindow;
+    long long                           m_submitted = 0;
+    std::atomic<int>                    m_maxBlobs;
+    cv::Ptr<cv::BackgroundSubtractor>   m_mog;
+
+    std::atomic<long long>              m_stageTicks[STAGES];
+    std::atomic<long long>              m_stageFrames[STAGES];
+    double                              m_latency = 0;
+    long long                           m_finished = 0;
+    double                              m_windowArea = 0;
+    long long                           m_dropped = 0;
+
+    PipelineFrame*  acquire(const cv::Mat &bgr, const int64 captureTicks, const ColorRange &range);
+    void            finish(const PipelineFrame &frame);
+    void            stageLoop(const int stage);
+    void            runStage(const int stage, PipelineFrame &frame);
+};
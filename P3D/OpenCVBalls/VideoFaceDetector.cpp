@@ -1,10 +1,32 @@
 #include "VideoFaceDetector.h"
 #include <iostream>
+#include <chrono>
+#include <algorithm>
 #include <opencv2\imgproc.hpp>
+#include <opencv2\video\video.hpp>
 
 const double VideoFaceDetector::TICK_FREQUENCY = cv::getTickFrequency();
 
+namespace
+{
+    // Frames of face positions kept to move late cascade results to the current frame
+    const size_t POSITION_HISTORY = 64;
+
+    // Corners seeded in a face, and the fewest that still give a reliable box
+    const int MAX_FEATURES = 40;
+    const size_t MIN_FEATURES = 8;
+    // Pixels a point may end away from where it started after tracking forward and back
+    const float MAX_FORWARD_BACKWARD_ERROR = 1.0f;
+
+    float median(std::vector<float> &values)
+    {
+        std::nth_element(values.begin(), values.begin() + values.size() / 2, values.end());
+        return values[values.size() / 2];
+    }
+}
+
 VideoFaceDetector::VideoFaceDetector(const std::string cascadeFilePath, cv::VideoCapture &videoCapture)
+    : m_jobs(1), m_results(1), m_cascadeRunning(false)
 {
     setFaceCascade(cascadeFilePath);
     setVideoCapture(videoCapture);
@@ -22,6 +44,9 @@ cv::VideoCapture *VideoFaceDetector::videoCapture() const
 
 void VideoFaceDetector::setFaceCascade(const std::string cascadeFilePath)
 {
+    // The cascade thread must not be using the classifier while it loads
+    stopCascadeThread();
+
     if (m_faceCascade == NULL) {
         m_faceCascade = new cv::CascadeClassifier(cascadeFilePath);
     }
@@ -50,14 +75,12 @@ int VideoFaceDetector::resizedWidth() const
     return m_resizedWidth;
 }
 
+/*
+* The biggest face being tracked, or the last one if every face was lost.
+*/
 cv::Rect VideoFaceDetector::face() const
 {
-    cv::Rect faceRect = m_trackedFace;
-    faceRect.x = (int)(faceRect.x / m_scale);
-    faceRect.y = (int)(faceRect.y / m_scale);
-    faceRect.width = (int)(faceRect.width / m_scale);
-    faceRect.height = (int)(faceRect.height / m_scale);
-    return faceRect;
+    return toFrame(m_trackedFace);
 }
 
 cv::Point VideoFaceDetector::facePosition() const
@@ -68,6 +91,40 @@ cv::Point VideoFaceDetector::facePosition() const
     return facePos;
 }
 
+std::vector<TrackedFace> VideoFaceDetector::faces() const
+{
+    std::vector<TrackedFace> faces;
+    for (auto &track : m_tracks) {
+        TrackedFace face;
+        face.id = track.id;
+        face.face = toFrame(track.face);
+        face.position = cv::Point((int)(track.position.x / m_scale), (int)(track.position.y / m_scale));
+        faces.push_back(face);
+    }
+    return faces;
+}
+
+void VideoFaceDetector::setMaxFaces(const int faces)
+{
+    m_maxFaces = std::max(faces, 1);
+    if ((int)m_tracks.size() > m_maxFaces) m_tracks.resize(m_maxFaces);
+}
+
+int VideoFaceDetector::maxFaces() const
+{
+    return m_maxFaces;
+}
+
+void VideoFaceDetector::setFullSearchInterval(const int frames)
+{
+    m_fullSearchInterval = std::max(frames, 1);
+}
+
+int VideoFaceDetector::fullSearchInterval() const
+{
+    return m_fullSearchInterval;
+}
+
 void VideoFaceDetector::setTemplateMatchingMaxDuration(const double s)
 {
     m_templateMatchingMaxDuration = s;
@@ -78,8 +135,79 @@ double VideoFaceDetector::templateMatchingMaxDuration() const
     return m_templateMatchingMaxDuration;
 }
 
+void VideoFaceDetector::setAsync(const bool async)
+{
+    m_async = async;
+    if (!m_async) stopCascadeThread();
+}
+
+bool VideoFaceDetector::async() const
+{
+    return m_async;
+}
+
+/*
+* Whether a cascade pass is on the cascade thread: its result is only merged by a later
+* call to detect(), so the caller must not stop calling it (e.g. on a still image).
+*/
+bool VideoFaceDetector::cascadePending() const
+{
+    return m_jobBusy;
+}
+
+void VideoFaceDetector::setMaxResultAge(const double s)
+{
+    m_maxResultAge = s;
+}
+
+double VideoFaceDetector::maxResultAge() const
+{
+    return m_maxResultAge;
+}
+
+void VideoFaceDetector::setTrackingMethod(const TrackingMethod method)
+{
+    m_trackingMethod = method;
+
+    // The points (or templates) of the other method are out of date
+    m_tracks.clear();
+    m_previousGray.release();
+}
+
+VideoFaceDetector::TrackingMethod VideoFaceDetector::trackingMethod() const
+{
+    return m_trackingMethod;
+}
+
+void VideoFaceDetector::setCascadeInterval(const int frames)
+{
+    m_cascadeInterval = std::max(frames, 1);
+}
+
+int VideoFaceDetector::cascadeInterval() const
+{
+    return m_cascadeInterval;
+}
+
+FaceTimings VideoFaceDetector::timings()
+{
+    FaceTimings timings;
+    timings.tracking = m_frames > 0 ? m_trackingTime / m_frames : 0;
+    timings.cascade = m_cascadePasses > 0 ? m_cascadeTime / m_cascadePasses : 0;
+    timings.frames = m_frames;
+    timings.cascadePasses = m_cascadePasses;
+    timings.stale = m_stale;
+    timings.faces = m_frames > 0 ? (double)m_trackedFaces / m_frames : 0;
+
+    m_trackingTime = m_cascadeTime = 0;
+    m_frames = m_cascadePasses = m_stale = m_trackedFaces = 0;
+    return timings;
+}
+
 VideoFaceDetector::~VideoFaceDetector()
 {
+    stopCascadeThread();
+
     if (m_faceCascade != NULL) {
         delete m_faceCascade;
     }
@@ -127,7 +255,7 @@ cv::Rect VideoFaceDetector::biggestFace(std::vector<cv::Rect> &faces) const
 
     cv::Rect *biggest = &faces[0];
     for (auto &face : faces) {
-        if (face.area() < biggest->area())
+        if (face.area() > biggest->area())
             biggest = &face;
     }
     return *biggest;
@@ -147,133 +275,484 @@ cv::Mat VideoFaceDetector::getFaceTemplate(const cv::Mat &frame, cv::Rect face)
     return faceTemplate;
 }
 
-void VideoFaceDetector::detectFaceAllSizes(const cv::Mat &frame)
+const VideoFaceDetector::FaceTrack* VideoFaceDetector::primaryTrack() const
 {
-    // Minimum face size is 1/5th of screen height
-    // Maximum face size is 2/3rds of screen height
-    m_faceCascade->detectMultiScale(frame, m_allFaces, 1.1, 3, 0,
-        cv::Size(frame.rows / 5, frame.rows / 5),
-        cv::Size(frame.rows * 2 / 3, frame.rows * 2 / 3));
+    const FaceTrack *primary = NULL;
+    for (auto &track : m_tracks) {
+        if (primary == NULL || track.face.area() > primary->face.area())
+            primary = &track;
+    }
+    return primary;
+}
 
-    if (m_allFaces.empty()) return;
+// From the downscaled frame to the frame given to detect()
+cv::Rect VideoFaceDetector::toFrame(const cv::Rect &rect) const
+{
+    cv::Rect faceRect = rect;
+    faceRect.x = (int)(faceRect.x / m_scale);
+    faceRect.y = (int)(faceRect.y / m_scale);
+    faceRect.width = (int)(faceRect.width / m_scale);
+    faceRect.height = (int)(faceRect.height / m_scale);
+    return faceRect;
+}
 
-    m_foundFace = true;
+cv::Point VideoFaceDetector::getFrameAndDetect(cv::Mat &frame)
+{
+    *m_videoCapture >> frame;
 
-    // Locate biggest face
-    m_trackedFace = biggestFace(m_allFaces);
+    return detect(frame);
+}
 
-    // Copy face template
-    m_faceTemplate = getFaceTemplate(frame, m_trackedFace);
+/*
+* Runs the detection on a frame that was captured elsewhere (e.g. by a capture thread).
+*/
+cv::Point VideoFaceDetector::detect(const cv::Mat &frame)
+{
+    m_context.reset(frame);
+    return detect(m_context);
+}
 
-    // Calculate roi
-    m_faceRoi = doubleRectSize(m_trackedFace, cv::Rect(0, 0, frame.cols, frame.rows));
+/*
+* Same, on the grey pyramid level of the frame's context closest to resizedWidth, so the
+* grey conversion and downscaling are shared with the other detectors of the frame. The
+* cascade, the templates and the optical flow all work on that grey image.
+*/
+cv::Point VideoFaceDetector::detect(FrameContext &context)
+{
+    return detect(context, cv::getTickCount() / TICK_FREQUENCY);
+}
 
-    // Update face position
-    m_facePosition = centerOfRect(m_trackedFace);
+/*
+* Same, with the time of the frame in seconds (e.g. its timestamp in a recorded video)
+* instead of the time it is given at. The timeouts, templateMatchingMaxDuration and
+* maxResultAge, then count frame time, so a replay does not depend on how fast it runs.
+*/
+cv::Point VideoFaceDetector::detect(FrameContext &context, const double time)
+{
+    int64 start = cv::getTickCount();
+    m_time = time;
+
+    // Downscale frame to m_resizedWidth width - keep aspect ratio
+    const cv::Size frameSize = context.size();
+    m_scale = (double) std::min(m_resizedWidth, frameSize.width) / frameSize.width;
+    cv::Size resizedFrameSize = cv::Size((int)(m_scale*frameSize.width), (int)(m_scale*frameSize.height));
+
+    // A copy even when the level has the right size: m_gray is kept as the previous frame
+    const cv::Mat &level = context.pyramid(context.levelFor(m_resizedWidth));
+    if (level.size() == resizedFrameSize)
+        level.copyTo(m_gray);
+    else
+        cv::resize(level, m_gray, resizedFrameSize, 0, 0, cv::INTER_AREA);
+
+    m_sequence++;
+    m_framesSinceFullSearch++;
+    for (auto &track : m_tracks) {
+        track.framesSinceCascade++;
+        track.confirmed = false;
+    }
+
+    // Cascade results first: a track the cascade just found does not need tracking
+    if (m_async) {
+        startCascadeThread();
+        CascadeJob *job;
+        if (m_results.pop(job)) {
+            m_jobBusy = false;
+            m_cascadeTime += job->duration;
+            m_cascadePasses++;
+            mergeCascadeResult(m_gray, *job);
+        }
+    }
+    else if (prepareCascadeJob(m_gray, m_job)) {
+        runCascadeJob(m_job);
+        m_cascadeTime += m_job.duration;
+        m_cascadePasses++;
+        mergeCascadeResult(m_gray, m_job);
+    }
+
+    for (auto &track : m_tracks) {
+        if (!track.confirmed && !track.lost) {
+            trackFace(m_gray, track);
+        }
+        track.positionHistory.push_back(std::make_pair(m_sequence, track.position));
+        if (track.positionHistory.size() > POSITION_HISTORY) track.positionHistory.pop_front();
+    }
+    m_tracks.erase(std::remove_if(m_tracks.begin(), m_tracks.end(), [](const FaceTrack &track) { return track.lost; }),
+        m_tracks.end());
+    removeDuplicateTracks();
+
+    if (m_async && !m_jobBusy && prepareCascadeJob(m_gray, m_job)) {
+        m_jobBusy = m_jobs.push(&m_job);
+    }
+
+    if (m_trackingMethod == OPTICAL_FLOW) {
+        cv::swap(m_gray, m_previousGray);
+    }
+
+    const FaceTrack *primary = primaryTrack();
+    if (primary != NULL) {
+        m_trackedFace = primary->face;
+        m_facePosition = primary->position;
+    }
+
+    m_trackingTime += (cv::getTickCount() - start) / TICK_FREQUENCY;
+    m_trackedFaces += m_tracks.size();
+    m_frames++;
+
+    return m_facePosition;
 }
 
-void VideoFaceDetector::detectFaceAroundRoi(const cv::Mat &frame)
+void VideoFaceDetector::startCascadeThread()
 {
-    // Detect faces sized +/-20% off biggest face in previous search
-    m_faceCascade->detectMultiScale(frame(m_faceRoi), m_allFaces, 1.1, 3, 0,
-        cv::Size(m_trackedFace.width * 8 / 10, m_trackedFace.height * 8 / 10),
-        cv::Size(m_trackedFace.width * 12 / 10, m_trackedFace.width * 12 / 10));
+    if (m_cascadeRunning) return;
 
-    if (m_allFaces.empty())
-    {
-        // Activate template matching if not already started and start timer
-        m_templateMatchingRunning = true;
-        if (m_templateMatchingStartTime == 0)
-            m_templateMatchingStartTime = cv::getTickCount();
+    m_cascadeRunning = true;
+    m_cascadeThread = std::thread(&VideoFaceDetector::cascadeLoop, this);
+}
+
+void VideoFaceDetector::stopCascadeThread()
+{
+    if (!m_cascadeRunning) return;
+
+    m_cascadeRunning = false;
+    m_cascadeThread.join();
+
+    // Whatever was in flight is dropped, and the job is ours again
+    CascadeJob *job;
+    while (m_jobs.pop(job)) {}
+    while (m_results.pop(job)) {}
+    m_jobBusy = false;
+}
+
+void VideoFaceDetector::cascadeLoop()
+{
+    while (m_cascadeRunning) {
+        CascadeJob *job;
+        if (!m_jobs.pop(job)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        runCascadeJob(*job);
+        m_results.push(job);
+    }
+}
+
+void VideoFaceDetector::runCascadeJob(CascadeJob &job)
+{
+    int64 start = cv::getTickCount();
+    for (auto &region : job.regions) {
+        m_faceCascade->detectMultiScale(job.frame(region.roi), region.faces, 1.1, 3, 0, region.minSize, region.maxSize);
+        for (auto &face : region.faces) {
+            face.x += region.roi.x;
+            face.y += region.roi.y;
+        }
+    }
+    job.duration = (cv::getTickCount() - start) / TICK_FREQUENCY;
+}
+
+/*
+* The cascade passes due on this frame: the roi of each track that needs one (faces
+* +/-20% of its size), and the whole frame (faces 1/5th to 2/3rds of its height) when
+* there are no tracks or it is time to look for more. Returns false if none are due.
+*/
+bool VideoFaceDetector::prepareCascadeJob(const cv::Mat &frame, CascadeJob &job)
+{
+    job.regions.clear();
+
+    for (auto &track : m_tracks) {
+        if (!cascadeDue(track)) continue;
+
+        CascadeRegion region;
+        region.trackId = track.id;
+        region.roi = track.roi;
+        region.minSize = cv::Size(track.face.width * 8 / 10, track.face.height * 8 / 10);
+        region.maxSize = cv::Size(track.face.width * 12 / 10, track.face.height * 12 / 10);
+        job.regions.push_back(region);
+        track.framesSinceCascade = 0;
+    }
+
+    if (m_tracks.empty() || ((int)m_tracks.size() < m_maxFaces && m_framesSinceFullSearch >= m_fullSearchInterval)) {
+        CascadeRegion region;
+        region.trackId = -1;
+        region.roi = cv::Rect(0, 0, frame.cols, frame.rows);
+        region.minSize = cv::Size(frame.rows / 5, frame.rows / 5);
+        region.maxSize = cv::Size(frame.rows * 2 / 3, frame.rows * 2 / 3);
+        job.regions.push_back(region);
+        m_framesSinceFullSearch = 0;
+    }
+
+    if (job.regions.empty()) return false;
+
+    // The cascade thread needs a copy; run here, the frame itself will do
+    if (m_async)
+        frame.copyTo(job.frame);
+    else
+        job.frame = frame;
+    job.sequence = m_sequence;
+    job.time = m_time;
+    return true;
+}
+
+/*
+* Each track takes the face found in its roi nearest to where it was on the job's frame,
+* moved by its motion since then. A track whose roi is empty starts the time allowed on
+* tracking alone, or is dropped if its tracking is lost as well. Faces found in the whole
+* frame away from every track start new tracks, biggest first, up to maxFaces.
+*/
+void VideoFaceDetector::mergeCascadeResult(const cv::Mat &frame, CascadeJob &job)
+{
+    double age = m_time - job.time;
+    if (age > m_maxResultAge) {
+        m_stale++;
         return;
     }
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+
+    // Where each track was on the job's frame
+    std::vector<cv::Point> motions(m_tracks.size(), cv::Point(0, 0));
+    for (size_t t = 0; t < m_tracks.size(); t++) {
+        for (auto &position : m_tracks[t].positionHistory) {
+            if (position.first == job.sequence) {
+                motions[t] = m_tracks[t].position - position.second;
+                break;
+            }
+        }
+    }
 
-    // Turn off template matching if running and reset timer
-    m_templateMatchingRunning = false;
-    m_templateMatchingCurrentTime = m_templateMatchingStartTime = 0;
+    for (auto &region : job.regions) {
+        if (region.trackId < 0) continue;
+
+        size_t t = 0;
+        while (t < m_tracks.size() && m_tracks[t].id != region.trackId) t++;
+        if (t == m_tracks.size()) continue;
+        FaceTrack &track = m_tracks[t];
+
+        const cv::Point then = track.position - motions[t];
+        const cv::Rect *nearest = NULL;
+        double nearestDistance = 0;
+        for (auto &face : region.faces) {
+            cv::Point d = centerOfRect(face) - then;
+            double distance = d.dot(d);
+            if (nearest == NULL || distance < nearestDistance) {
+                nearest = &face;
+                nearestDistance = distance;
+            }
+        }
 
-    // Get detected face
-    m_trackedFace = biggestFace(m_allFaces);
+        if (nearest == NULL) {
+            if (!track.trackGood)
+                track.lost = true;
+            else if (track.unconfirmedSince < 0)
+                track.unconfirmedSince = m_time;
+            continue;
+        }
+        confirmFace(frame, track, (*nearest + motions[t]) & frameRect);
+    }
+
+    for (auto &region : job.regions) {
+        if (region.trackId >= 0) continue;
+
+        while (!region.faces.empty() && (int)m_tracks.size() < m_maxFaces) {
+            cv::Rect face = biggestFace(region.faces);
+            region.faces.erase(std::find(region.faces.begin(), region.faces.end(), face));
+
+            bool known = false;
+            for (size_t t = 0; t < m_tracks.size() && !known; t++) {
+                cv::Point motion = t < motions.size() ? motions[t] : cv::Point(0, 0);
+                known = (m_tracks[t].face - motion).contains(centerOfRect(face));
+            }
+            if (known) continue;
+
+            FaceTrack track;
+            track.id = m_nextId++;
+            track.seededPoints = 0;
+            track.trackGood = true;
+            track.framesSinceCascade = 0;
+            track.unconfirmedSince = -1;
+            track.lost = false;
+            track.confirmed = false;
+            confirmFace(frame, track, face & frameRect);
+            if (track.confirmed) m_tracks.push_back(track);
+        }
+    }
+}
 
-    // Add roi offset to face
-    m_trackedFace.x += m_faceRoi.x;
-    m_trackedFace.y += m_faceRoi.y;
+void VideoFaceDetector::confirmFace(const cv::Mat &frame, FaceTrack &track, const cv::Rect &face)
+{
+    if (face.width < 8 || face.height < 8) return;
 
-    // Get face template
-    m_faceTemplate = getFaceTemplate(frame, m_trackedFace);
+    track.face = face;
+    track.faceTemplate = getFaceTemplate(frame, face);
+    track.roi = doubleRectSize(face, cv::Rect(0, 0, frame.cols, frame.rows));
+    track.position = centerOfRect(face);
 
-    // Calculate roi
-    m_faceRoi = doubleRectSize(m_trackedFace, cv::Rect(0, 0, frame.cols, frame.rows));
+    // Seed the points followed by optical flow
+    if (m_trackingMethod == OPTICAL_FLOW) seedFeatures(track);
 
-    // Update face position
-    m_facePosition = centerOfRect(m_trackedFace);
+    // The cascade confirmed the face: restart the time allowed on tracking alone
+    track.unconfirmedSince = -1;
+    track.framesSinceCascade = 0;
+    track.confirmed = true;
+}
+
+/*
+* Two tracks that ended up on the same face: the newer one goes.
+*/
+void VideoFaceDetector::removeDuplicateTracks()
+{
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        for (size_t j = i + 1; j < m_tracks.size(); j++) {
+            if (m_tracks[i].face.contains(m_tracks[j].position) || m_tracks[j].face.contains(m_tracks[i].position)) {
+                m_tracks.erase(m_tracks.begin() + j);
+                j--;
+            }
+        }
+    }
 }
 
-void VideoFaceDetector::detectFacesTemplateMatching(const cv::Mat &frame)
+/*
+* Follows a face between cascade passes. The track is dropped when no pass has found its
+* face for templateMatchingMaxDuration seconds.
+*/
+void VideoFaceDetector::trackFace(const cv::Mat &frame, FaceTrack &track)
 {
-    // Calculate duration of template matching
-    m_templateMatchingCurrentTime = cv::getTickCount();
-    double duration = (double)(m_templateMatchingCurrentTime - m_templateMatchingStartTime) / TICK_FREQUENCY;
+    if (track.unconfirmedSince < 0)
+        track.unconfirmedSince = m_time;
+
+    if (m_trackingMethod == TEMPLATE_MATCHING)
+        detectFacesTemplateMatching(frame, track);
+    else
+        trackFeatures(track, cv::Rect(0, 0, frame.cols, frame.rows));
 
-    // If template matching lasts for more than 2 seconds face is possibly lost
-    // so disable it and redetect using cascades
-    if (duration > m_templateMatchingMaxDuration) {
-        m_foundFace = false;
-        m_templateMatchingRunning = false;
-        m_templateMatchingStartTime = m_templateMatchingCurrentTime = 0;
+    if (m_time - track.unconfirmedSince > m_templateMatchingMaxDuration) {
+        track.lost = true;
     }
+}
 
-    // Template matching with last known face 
-    //cv::matchTemplate(frame(m_faceRoi), m_faceTemplate, m_matchingResult, CV_TM_CCOEFF);
-    cv::matchTemplate(frame(m_faceRoi), m_faceTemplate, m_matchingResult, CV_TM_SQDIFF_NORMED);
+void VideoFaceDetector::detectFacesTemplateMatching(const cv::Mat &frame, FaceTrack &track)
+{
+    if (track.faceTemplate.empty() || track.roi.width < track.faceTemplate.cols || track.roi.height < track.faceTemplate.rows) {
+        track.lost = true;
+        return;
+    }
+
+    // Template matching with last known face
+    cv::matchTemplate(frame(track.roi), track.faceTemplate, m_matchingResult, CV_TM_SQDIFF_NORMED);
     cv::normalize(m_matchingResult, m_matchingResult, 0, 1, cv::NORM_MINMAX, -1, cv::Mat());
     double min, max;
     cv::Point minLoc, maxLoc;
     cv::minMaxLoc(m_matchingResult, &min, &max, &minLoc, &maxLoc);
 
     // Add roi offset to face position
-    minLoc.x += m_faceRoi.x;
-    minLoc.y += m_faceRoi.y;
+    minLoc.x += track.roi.x;
+    minLoc.y += track.roi.y;
 
     // Get detected face
-    //m_trackedFace = cv::Rect(maxLoc.x, maxLoc.y, m_trackedFace.width, m_trackedFace.height);
-    m_trackedFace = cv::Rect(minLoc.x, minLoc.y, m_faceTemplate.cols, m_faceTemplate.rows);
-    m_trackedFace = doubleRectSize(m_trackedFace, cv::Rect(0, 0, frame.cols, frame.rows));
+    track.face = cv::Rect(minLoc.x, minLoc.y, track.faceTemplate.cols, track.faceTemplate.rows);
+    track.face = doubleRectSize(track.face, cv::Rect(0, 0, frame.cols, frame.rows));
 
     // Get new face template
-    m_faceTemplate = getFaceTemplate(frame, m_trackedFace);
+    track.faceTemplate = getFaceTemplate(frame, track.face);
 
     // Calculate face roi
-    m_faceRoi = doubleRectSize(m_trackedFace, cv::Rect(0, 0, frame.cols, frame.rows));
+    track.roi = doubleRectSize(track.face, cv::Rect(0, 0, frame.cols, frame.rows));
 
     // Update face position
-    m_facePosition = centerOfRect(m_trackedFace);
+    track.position = centerOfRect(track.face);
 }
 
-cv::Point VideoFaceDetector::getFrameAndDetect(cv::Mat &frame)
+/*
+* Corners of the middle of the track's face in the current grey frame, away from the
+* background at the sides of the box.
+*/
+void VideoFaceDetector::seedFeatures(FaceTrack &track)
 {
-    *m_videoCapture >> frame;
+    cv::Rect inner(track.face.x + track.face.width / 5, track.face.y + track.face.height / 5,
+        track.face.width * 3 / 5, track.face.height * 3 / 5);
+    inner &= cv::Rect(0, 0, m_gray.cols, m_gray.rows);
 
-    // Downscale frame to m_resizedWidth width - keep aspect ratio
-    m_scale = (double) std::min(m_resizedWidth, frame.cols) / frame.cols;
-    cv::Size resizedFrameSize = cv::Size((int)(m_scale*frame.cols), (int)(m_scale*frame.rows));
+    track.points.clear();
+    if (inner.width > 0 && inner.height > 0) {
+        cv::goodFeaturesToTrack(m_gray(inner), track.points, MAX_FEATURES, 0.01, std::max(inner.width / 10, 2));
+    }
+    for (auto &point : track.points) {
+        point.x += inner.x;
+        point.y += inner.y;
+    }
 
-    cv::Mat resizedFrame;
-    cv::resize(frame, resizedFrame, resizedFrameSize);
+    track.seededPoints = track.points.size();
+    track.trackGood = track.seededPoints >= MIN_FEATURES;
+}
 
-    if (!m_foundFace)
-        detectFaceAllSizes(resizedFrame); // Detect using cascades over whole image
-    else {
-        detectFaceAroundRoi(resizedFrame); // Detect using cascades only in ROI
-        if (m_templateMatchingRunning) {
-            detectFacesTemplateMatching(resizedFrame); // Detect using template matching
+/*
+* Moves the face box with the points from the previous frame to this one. Returns false,
+* and leaves the box where it was, when too few points could be followed; the track is
+* also marked as poor once less than half of the seeded points are left.
+*/
+bool VideoFaceDetector::trackFeatures(FaceTrack &track, const cv::Rect &frameSize)
+{
+    std::vector<cv::Point2f> &points = track.points;
+    track.trackGood = false;
+    if (points.size() < MIN_FEATURES || m_previousGray.size() != m_gray.size()) return false;
+
+    // Forward, then back again: a point that does not return to where it started was lost
+    cv::calcOpticalFlowPyrLK(m_previousGray, m_gray, points, m_nextPoints, m_status, m_errors, cv::Size(15, 15), 2);
+    cv::calcOpticalFlowPyrLK(m_gray, m_previousGray, m_nextPoints, m_backPoints, m_backStatus, m_errors, cv::Size(15, 15), 2);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        cv::Point2f error = m_backPoints[i] - points[i];
+        if (!m_status[i] || !m_backStatus[i] || error.dot(error) > MAX_FORWARD_BACKWARD_ERROR * MAX_FORWARD_BACKWARD_ERROR) continue;
+        points[kept] = points[i];
+        m_nextPoints[kept] = m_nextPoints[i];
+        kept++;
+    }
+    points.resize(kept);
+    m_nextPoints.resize(kept);
+    if (kept < MIN_FEATURES) {
+        points.clear();
+        return false;
+    }
+
+    // Similarity fit from medians, so a few badly followed points do not move the box
+    std::vector<float> dx(kept), dy(kept), ratios;
+    for (size_t i = 0; i < kept; i++) {
+        dx[i] = m_nextPoints[i].x - points[i].x;
+        dy[i] = m_nextPoints[i].y - points[i].y;
+        for (size_t j = i + 1; j < kept; j++) {
+            cv::Point2f before = points[i] - points[j], after = m_nextPoints[i] - m_nextPoints[j];
+            float distance = std::sqrt(before.dot(before));
+            if (distance > 2.0f) ratios.push_back(std::sqrt(after.dot(after)) / distance);
         }
     }
+    float scale = ratios.empty() ? 1.0f : median(ratios);
+    float centerX = track.face.x + track.face.width / 2.0f + median(dx);
+    float centerY = track.face.y + track.face.height / 2.0f + median(dy);
+    float width = track.face.width * scale, height = track.face.height * scale;
+
+    cv::Rect face(cvRound(centerX - width / 2), cvRound(centerY - height / 2), cvRound(width), cvRound(height));
+    face &= frameSize;
+    if (face.width < 8 || face.height < 8) return false;
+
+    track.face = face;
+    track.roi = doubleRectSize(track.face, frameSize);
+    track.position = centerOfRect(track.face);
+    points.swap(m_nextPoints);
+
+    track.trackGood = kept * 2 >= track.seededPoints;
+    return track.trackGood;
+}
 
-    return m_facePosition;
+/*
+* Template matching needs the cascade every frame; optical flow only every cascadeInterval
+* frames, or when the points are lost.
+*/
+bool VideoFaceDetector::cascadeDue(const FaceTrack &track) const
+{
+    return m_trackingMethod == TEMPLATE_MATCHING || !track.trackGood || track.framesSinceCascade >= m_cascadeInterval;
 }
 
 cv::Point VideoFaceDetector::operator>>(cv::Mat &frame)
 {
     return this->getFrameAndDetect(frame);
-}
\ No newline at end of file
+}
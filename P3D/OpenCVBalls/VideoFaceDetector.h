@@ -1,17 +1,78 @@
 #pragma once
 
+#include <thread>
+#include <atomic>
+#include <deque>
 #include <opencv2\core.hpp>
 #include <opencv2\highgui\highgui.hpp>
 #include <opencv2\objdetect\objdetect.hpp>
+#include "SpscQueue.h"
+#include "FrameContext.h"
 
+/*
+* Average time per frame spent in detect() on the caller's thread, and per batch of
+* cascade passes, over the frames since the previous call to timings(). Cascade batches
+* whose result came back too late to be used are counted as stale.
+*/
+struct FaceTimings
+{
+    double      tracking;
+    double      cascade;
+    long long   frames;
+    long long   cascadePasses;
+    long long   stale;
+    double      faces;          // average number of faces tracked
+};
+
+// A face being tracked, in the coordinates of the frames given to detect()
+struct TrackedFace
+{
+    int         id;
+    cv::Rect    face;
+    cv::Point   position;
+};
+
+/*
+* Tracks up to maxFaces faces, each in its own entry of a small track table with an id,
+* the roi around it and the state of its tracker. The cascade runs once per track, only
+* inside that track's roi and only for faces of about its size; the whole frame is only
+* searched while there are no tracks, and every fullSearchInterval frames while there is
+* room for more, so the cost grows with the number of faces far slower than a full frame
+* pass per face would.
+*
+* With async on (the default), the cascade passes run on a thread of their own, on the
+* latest downscaled frame handed to it whenever it is free. detect() only tracks the
+* faces from frame to frame, so its cost does not depend on the cascade's. The results
+* are merged in when they arrive, moved by however much each face moved since the frame
+* they were computed on, unless they are older than maxResultAge seconds.
+*
+* Between cascade passes each face is followed either by template matching or, by default,
+* by optical flow: corners found inside the face by goodFeaturesToTrack are followed with
+* pyramidal Lucas-Kanade, points failing a forward-backward check are dropped, and the box
+* moves and scales by the median displacement and the median change of the distances
+* between points. With optical flow the cascade only runs on a track every
+* cascadeInterval frames, or as soon as too few of its points survive.
+*
+* A track is dropped when the cascade has not found its face for templateMatchingMaxDuration
+* seconds, or at once when its points are lost and the cascade misses it too.
+*/
 class VideoFaceDetector
 {
 public:
+    enum TrackingMethod
+    {
+        TEMPLATE_MATCHING,
+        OPTICAL_FLOW
+    };
+
     VideoFaceDetector(const std::string cascadeFilePath, cv::VideoCapture &videoCapture);
     ~VideoFaceDetector();
 
     cv::Point               getFrameAndDetect(cv::Mat &frame);
     cv::Point               operator>>(cv::Mat &frame);
+    cv::Point               detect(const cv::Mat &frame);
+    cv::Point               detect(FrameContext &context);
+    cv::Point               detect(FrameContext &context, const double time);
     void                    setVideoCapture(cv::VideoCapture &videoCapture);
     cv::VideoCapture*       videoCapture() const;
     void                    setFaceCascade(const std::string cascadeFilePath);
@@ -20,34 +81,124 @@ public:
     int                     resizedWidth() const;
     cv::Rect                face() const;
     cv::Point               facePosition() const;
+    std::vector<TrackedFace> faces() const;
+    void                    setMaxFaces(const int faces);
+    int                     maxFaces() const;
+    void                    setFullSearchInterval(const int frames);
+    int                     fullSearchInterval() const;
     void                    setTemplateMatchingMaxDuration(const double s);
     double                  templateMatchingMaxDuration() const;
+    void                    setAsync(const bool async);
+    bool                    async() const;
+    bool                    cascadePending() const;
+    void                    setMaxResultAge(const double s);
+    double                  maxResultAge() const;
+    void                    setTrackingMethod(const TrackingMethod method);
+    TrackingMethod          trackingMethod() const;
+    void                    setCascadeInterval(const int frames);
+    int                     cascadeInterval() const;
+    FaceTimings             timings();
 
 private:
     static const double     TICK_FREQUENCY;
 
+    // One face of the track table, in the coordinates of the downscaled frame
+    struct FaceTrack
+    {
+        int                     id;
+        cv::Rect                face;
+        cv::Rect                roi;
+        cv::Point               position;
+        cv::Mat                 faceTemplate;
+        std::vector<cv::Point2f> points;            // followed corners, in the previous frame
+        size_t                  seededPoints;
+        bool                    trackGood;
+        int                     framesSinceCascade;
+        double                  unconfirmedSince;   // < 0 while the cascade keeps finding the face
+        bool                    lost;
+        bool                    confirmed;          // by a cascade pass in this frame
+        std::deque<std::pair<long long, cv::Point> > positionHistory;  // face position of recent frames
+    };
+
+    // Where a cascade pass looks, and what it found (in frame coordinates)
+    struct CascadeRegion
+    {
+        int                     trackId;            // -1 for the whole frame
+        cv::Rect                roi;
+        cv::Size                minSize, maxSize;
+        std::vector<cv::Rect>   faces;
+    };
+
+    // The cascade passes of one frame, handed to the cascade thread
+    struct CascadeJob
+    {
+        cv::Mat                 frame;
+        std::vector<CascadeRegion> regions;
+        long long               sequence;
+        double                  time;               // of the frame handed over
+        double                  duration;
+    };
+
     cv::VideoCapture*       m_videoCapture = NULL;
     cv::CascadeClassifier*  m_faceCascade = NULL;
-    std::vector<cv::Rect>   m_allFaces;
-    cv::Rect                m_trackedFace;
-    cv::Rect                m_faceRoi;
-    cv::Mat                 m_faceTemplate;
-    cv::Mat                 m_matchingResult;
-    bool                    m_templateMatchingRunning = false;
-    int64                   m_templateMatchingStartTime = 0;
-    int64                   m_templateMatchingCurrentTime = 0;
-    bool                    m_foundFace = false;
-    double                  m_scale;
+    double                  m_scale = 1;
     int                     m_resizedWidth = 320;
-    cv::Point               m_facePosition;
     double                  m_templateMatchingMaxDuration = 3;
+    cv::Mat                 m_matchingResult;
+    FrameContext            m_context;          // for frames given to detect() as a Mat
+    double                  m_time = 0;         // of the current frame, in seconds
+
+    std::vector<FaceTrack>  m_tracks;
+    cv::Rect                m_trackedFace;      // the biggest face, kept when it is lost
+    cv::Point               m_facePosition;
+    int                     m_nextId = 0;
+    int                     m_maxFaces = 4;
+    int                     m_fullSearchInterval = 30;
+    int                     m_framesSinceFullSearch = 0;
+
+    bool                    m_async = true;
+    double                  m_maxResultAge = 0.5;
+    long long               m_sequence = 0;
+    CascadeJob              m_job;
+    bool                    m_jobBusy = false;  // m_job belongs to the cascade thread
+    SpscQueue<CascadeJob*>  m_jobs;
+    SpscQueue<CascadeJob*>  m_results;
+    std::thread             m_cascadeThread;
+    std::atomic<bool>       m_cascadeRunning;
+
+    TrackingMethod          m_trackingMethod = OPTICAL_FLOW;
+    int                     m_cascadeInterval = 10;
+    cv::Mat                 m_gray, m_previousGray;
+    std::vector<cv::Point2f> m_nextPoints, m_backPoints;
+    std::vector<uchar>      m_status, m_backStatus;
+    std::vector<float>      m_errors;
+
+    double                  m_trackingTime = 0;
+    double                  m_cascadeTime = 0;
+    long long               m_frames = 0;
+    long long               m_cascadePasses = 0;
+    long long               m_stale = 0;
+    long long               m_trackedFaces = 0;
 
     cv::Rect    doubleRectSize(const cv::Rect &inputRect, const cv::Rect &frameSize) const;
     cv::Rect    biggestFace(std::vector<cv::Rect> &faces) const;
     cv::Point   centerOfRect(const cv::Rect &rect) const;
     cv::Mat     getFaceTemplate(const cv::Mat &frame, cv::Rect face);
-    void        detectFaceAllSizes(const cv::Mat &frame);
-    void        detectFaceAroundRoi(const cv::Mat &frame);
-    void        detectFacesTemplateMatching(const cv::Mat &frame);
-};
+    const FaceTrack*    primaryTrack() const;
+    cv::Rect    toFrame(const cv::Rect &rect) const;
 
+    void        startCascadeThread();
+    void        stopCascadeThread();
+    void        cascadeLoop();
+    void        runCascadeJob(CascadeJob &job);
+    bool        prepareCascadeJob(const cv::Mat &frame, CascadeJob &job);
+    void        mergeCascadeResult(const cv::Mat &frame, CascadeJob &job);
+    void        confirmFace(const cv::Mat &frame, FaceTrack &track, const cv::Rect &face);
+    void        removeDuplicateTracks();
+
+    void        trackFace(const cv::Mat &frame, FaceTrack &track);
+    void        detectFacesTemplateMatching(const cv::Mat &frame, FaceTrack &track);
+    void        seedFeatures(FaceTrack &track);
+    bool        trackFeatures(FaceTrack &track, const cv::Rect &frameSize);
+    bool        cascadeDue(const FaceTrack &track) const;
+};
@@ -0,0 +1,192 @@
+#include "VideoRecorder.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+VideoRecorder::VideoRecorder(const size_t queueCapacity)
+    : m_grabbed(0), m_written(0), m_dropped(0)
+{
+    m_queueCapacity = std::max(queueCapacity, (size_t)1);
+    m_pbos[0] = m_pbos[1] = 0;
+}
+
+VideoRecorder::~VideoRecorder()
+{
+    stop();
+}
+
+bool VideoRecorder::start(const std::string &fileName, const int width, const int height, const double fps, const int fourcc)
+{
+    if (m_recording) {
+        stop();
+    }
+
+    if (!m_writer.open(fileName, fourcc, fps, cv::Size(width, height), true)) {
+        std::cerr << "Error opening " << fileName << " for recording." << std::endl;
+        return false;
+    }
+
+    m_fileName = fileName;
+    m_width = width;
+    m_height = height;
+    m_grabbed = 0;
+    m_written = 0;
+    m_dropped = 0;
+    m_stopping = false;
+    m_pboPending = false;
+    m_pboIndex = 0;
+
+    // Without pixel buffer objects glReadPixels is synchronous, but encoding still is not
+    m_usePbo = GLEW_ARB_pixel_buffer_object != 0;
+    if (m_usePbo) {
+        glGenBuffers(2, m_pbos);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 3, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    m_thread = std::thread(&VideoRecorder::writerLoop, this);
+    m_recording = true;
+
+    return true;
+}
+
+/*
+* Flushes the frames still queued, closes the file and reports how many frames were lost.
+*/
+void VideoRecorder::stop()
+{
+    if (!m_recording) return;
+    m_recording = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_frameReady.notify_one();
+    m_thread.join();
+    m_writer.release();
+
+    if (m_usePbo) {
+        glDeleteBuffers(2, m_pbos);
+        m_pbos[0] = m_pbos[1] = 0;
+    }
+    m_queue.clear();
+    m_freeFrames.clear();
+
+    std::cout << "Recorded " << m_fileName << ": " << m_written << " frames written, "
+        << m_dropped << " of " << m_grabbed << " dropped." << std::endl;
+}
+
+bool VideoRecorder::isRecording() const
+{
+    return m_recording;
+}
+
+void VideoRecorder::grab()
+{
+    if (!m_recording) return;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadBuffer(GL_BACK);
+
+    if (!m_usePbo) {
+        cv::Mat frame = takeFreeFrame();
+        glReadPixels(0, 0, m_width, m_height, GL_BGR, GL_UNSIGNED_BYTE, frame.data);
+        push(frame);
+        return;
+    }
+
+    // Queue the read of this frame, it completes while the next one is being rendered
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[m_pboIndex]);
+    glReadPixels(0, 0, m_width, m_height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+
+    // And collect the one started last frame, which by now is already in memory
+    if (m_pboPending) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_pbos[1 - m_pboIndex]);
+        const unsigned char *pixels = (const unsigned char *)glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (pixels != NULL) {
+            cv::Mat frame = takeFreeFrame();
+            memcpy(frame.data, pixels, m_width * m_height * 3);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            push(frame);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    m_pboPending = true;
+    m_pboIndex = 1 - m_pboIndex;
+}
+
+long long VideoRecorder::framesGrabbed() const
+{
+    return m_grabbed;
+}
+
+long long VideoRecorder::framesWritten() const
+{
+    return m_written;
+}
+
+long long VideoRecorder::framesDropped() const
+{
+    return m_dropped;
+}
+
+/*
+* Frames are recycled between the render loop and the encoder, so after the first few
+* frames no memory is allocated while recording.
+*/
+cv::Mat VideoRecorder::takeFreeFrame()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_freeFrames.empty()) {
+            cv::Mat frame = m_freeFrames.back();
+            m_freeFrames.pop_back();
+            return frame;
+        }
+    }
+    return cv::Mat(m_height, m_width, CV_8UC3);
+}
+
+void VideoRecorder::push(cv::Mat &frame)
+{
+    m_grabbed++;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queue.size() >= m_queueCapacity) {
+            m_freeFrames.push_back(m_queue.front());
+            m_queue.pop_front();
+            m_dropped++;
+        }
+        m_queue.push_back(frame);
+    }
+    m_frameReady.notify_one();
+}
+
+void VideoRecorder::writerLoop()
+{
+    cv::Mat flipped;
+
+    for (;;) {
+        cv::Mat frame;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_frameReady.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) break;
+            frame = m_queue.front();
+            m_queue.pop_front();
+        }
+
+        // OpenGL rows go bottom up
+        cv::flip(frame, flipped, 0);
+        m_writer.write(flipped);
+        m_written++;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_freeFrames.push_back(frame);
+    }
+}
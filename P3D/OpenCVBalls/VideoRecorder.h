@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <opencv2\core.hpp>
+#include <opencv2\highgui\highgui.hpp>
+#include "Dependencies\glew\glew.h"
+
+/*
+* Records the composited OpenGL output to a video file.
+* grab() is called from the render loop after drawing and before swapping buffers. It starts
+* an asynchronous read of the back buffer into a pixel buffer object and hands the previous
+* frame to an encoder thread. Frames waiting to be encoded live in a bounded queue; when the
+* encoder falls behind the oldest frame is dropped, so the render loop never waits for it.
+*/
+class VideoRecorder
+{
+public:
+    VideoRecorder(const size_t queueCapacity = 8);
+    ~VideoRecorder();
+
+    bool                    start(const std::string &fileName, const int width, const int height, const double fps,
+                                  const int fourcc = CV_FOURCC('M', 'J', 'P', 'G'));
+    void                    stop();
+    bool                    isRecording() const;
+    void                    grab();
+    long long               framesGrabbed() const;
+    long long               framesWritten() const;
+    long long               framesDropped() const;
+
+private:
+    size_t                  m_queueCapacity;
+    int                     m_width = 0;
+    int                     m_height = 0;
+    bool                    m_recording = false;
+    std::string             m_fileName;
+
+    // Two pixel buffers: the GPU fills one while the other, filled last frame, is read back
+    GLuint                  m_pbos[2];
+    int                     m_pboIndex = 0;
+    bool                    m_pboPending = false;
+    bool                    m_usePbo = false;
+
+    cv::VideoWriter         m_writer;
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_frameReady;
+    std::deque<cv::Mat>     m_queue;
+    std::vector<cv::Mat>    m_freeFrames;
+    bool                    m_stopping = false;
+
+    std::atomic<long long>  m_grabbed;
+    std::atomic<long long>  m_written;
+    std::atomic<long long>  m_dropped;
+
+    cv::Mat     takeFreeFrame();
+    void        push(cv::Mat &frame);
+    void        writerLoop();
+};
@@ -28,6 +28,36 @@ Controlos:
 q - Sair
 m - Prximo modo
 n - Prxima textura / modelo (modos 3 e 4)
+r - Iniciar / parar a gravao de video (gravacao_N.avi)
+--bench-background - Compara o glDrawPixels com a textura para o fundo da camara e sai
+--bench-filter - Compara o filtro de cor fundido com a sequncia de chamadas do OpenCV e sai
+--bench-lut - Compara a tabela de cores BGR com cvtColor + filtro HSV e sai
+w - Liga / desliga a procura da bola s numa janela  volta da posio prevista (modos 1 e 2)
++ / - - Aumenta / diminui o nmero de frames entre detees da bola (modos 1 e 2)
+--bench-blob - Compara a anlise de blobs numa s passagem com findContours e sai
+o - Segue s a maior bola / at 4 bolas (modos 1 e 2)
+u - Altera o undistort: frame inteiro, mapas em cache ou s os cantos (modo 4)
+--bench-undistort - Compara cv::undistort, o remap com mapas em cache e o undistort s dos cantos e sai
+t - Liga / desliga a procura dos marcadores s em janelas  volta dos do frame anterior (modo 4)
+--bench-markers - Compara a deteo de marcadores no frame inteiro com a procura em janelas e sai
+c - Resoluo da procura de marcadores: automtica, 1, 1/2 ou 1/4 (modo 4)
+p - Liga / desliga a deteo dos marcadores repartida pelos ncleos (modo 4)
+--bench-parallel-markers - Compara a deteo da aruco com a deteo em paralelo e verifica que do os mesmos marcadores
+e - Liga / desliga a pose de cada marcador a partir da do frame anterior (modo 4)
+--bench-pose - Compara o tempo e a estabilidade da pose calculada do zero e a partir do frame anterior e sai
+a - Liga / desliga a cascade de faces numa thread prpria (modo 3)
+f - Seguimento da face por pontos (Lucas-Kanade) ou por template matching (modo 3)
+v - Segue s a maior face / at vrias faces (modo 3)
+g - Liga / desliga a deteo s quando h movimento na imagem
+--source <video | padrao%04d.png | cmara> - L os frames de um vdeo ou sequncia de imagens em vez da webcam
+--fps <n> - L o ficheiro a essa taxa de frames; --unpaced o mais depressa possvel
+--loop - Repete o ficheiro; --seek <n> comea nesse frame
+--headless <color | face | marker> - Corre s a deteo desse modo, sem janelas, e mostra os tempos de cada etapa
+--frames <n> - Limita os frames processados; --log <ficheiro.csv> guarda os tempos de cada frame
+--no-gate - Corre a deteo em todos os frames, mesmo sem movimento
+--batch <color | face | marker> video1 video2 ... - Corre a deteo nos vdeos, vrios em paralelo, e guarda os resultados de cada frame
+@lista.txt - L os vdeos do --batch de um ficheiro (um por linha)
+--format csv | binary - Formato dos resultados; --workers <n> threads; --out-dir <pasta> onde ficam
 
 Dependncias / Frameworks utilizadas:
 
@@ -59,6 +89,8 @@ http://www.pobox.com/~nate
 #pragma region Includes
 
 #include <iostream>
+#include <map>
+#include <fstream>
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
 #include <opencv2/video/video.hpp>
@@ -71,6 +103,18 @@ http://www.pobox.com/~nate
 #include <math.h>
 #include "tga.h"
 #include "VideoFaceDetector.h"
+#include "TextureAtlas.h"
+#include "VideoRecorder.h"
+#include "CameraBackground.h"
+#include "FrameGrabber.h"
+#include "FrameSource.h"
+#include "HeadlessRunner.h"
+#include "BatchProcessor.h"
+#include "TrackingPipeline.h"
+#include "BlobTracker.h"
+#include "MarkerUndistortion.h"
+#include "FrameContext.h"
+#include "MotionGate.h"
 #include "glm.h"
 
 #pragma endregion
@@ -86,34 +130,55 @@ using namespace aruco;
 #pragma region Propriedades
 
 //Materiais utilizados
-Mat frameOriginal, frameHSV, frameFiltered, frameFlipped, fgMaskMOG, controlFlipped, tempimage, tempimage2, 
-	faceDetection, undistorted;
-
-//Instncia de MOG Background subtractor
-Ptr<BackgroundSubtractor> pMOG; 
+Mat frameOriginal, tempimage, undistorted;
+//Imagem cinzenta e piramide de cada frame, calculadas uma vez e partilhadas pelos detetores (a da camara e a rodada do modo 4)
+FrameContext frameContext, markerFrameContext;
+
+//Tracking por cor dos modos 1 e 2, em pipeline (cada etapa numa thread, com o MOG background subtractor)
+TrackingPipeline trackingPipeline;
+//Bolas seguidas de frame para frame, cada uma com filtros de Kalman (velocidade constante) da posio e do raio,
+//previstos para o instante do render. A bola principal controla a camara / planeta, as outras so planetas extra
+const int maxBolas = 4;
+BlobTracker ballTracker(maxBolas);
+vector<Vec3f> otherBalls;
+//A deteo corre a cada detectionInterval frames da camara (teclas + e -), o render continua suave
+int detectionInterval = 1;
+int framesUntilDetection = 0;
+//Deteo (cor, faces ou marcadores) s quando a imagem mudou desde a ltima que correu (tecla G)
+MotionGate motionGate;
 
 //Valores iniciais do filtro de cor
-int iLowH = 0;
-int iHighH = 179;
-int iLowS = 133;
-int iHighS = 250;
-int iLowV = 180;
-int iHighV = 255;
-
-//Instncia de camera capture
-VideoCapture cap(CV_CAP_ANY);
+int iLowH = ColorTracker::DEFAULT_RANGE.lowH;
+int iHighH = ColorTracker::DEFAULT_RANGE.highH;
+int iLowS = ColorTracker::DEFAULT_RANGE.lowS;
+int iHighS = ColorTracker::DEFAULT_RANGE.highS;
+int iLowV = ColorTracker::DEFAULT_RANGE.lowV;
+int iHighV = ColorTracker::DEFAULT_RANGE.highV;
+
+//Origem dos frames: a webcam, ou um video / sequncia de imagens (--source)
+FrameSource cap;
 bool frameCapturedSuccessfully = false;
-//Dimenses do frame capturado / janela glut
-int width = cap.get(CV_CAP_PROP_FRAME_WIDTH);
-int height = cap.get(CV_CAP_PROP_FRAME_HEIGHT);
+//Captura da camara numa thread prpria (triple buffer de frames)
+FrameGrabber grabber(cap);
+//Existe um frame novo por processar / instante em que foi capturado
+bool newFrame = false;
+int64 frameCaptureTicks = 0;
+//Estatsticas de render e de latncia captura -> ecr, mostradas uma vez por segundo
+int64 statsStartTicks = 0;
+int renderedFrames = 0, displayedFrames = 0;
+double latencySum = 0;
+//Dimenses do frame capturado / janela glut (definidas quando a origem dos frames  aberta)
+int width = 640;
+int height = 480;
 Size GlWindowSize = Size(width, height);
 
 //Classificadores para faces e olhos
 char *classifierFaces = "haarcascade_frontalface_default.xml";
 char *classifierEyes = "haarcascade_mcs_eyepair_big.xml";
 
-//Detector de faces
-VideoFaceDetector detector(classifierFaces, cap);
+//Detector de faces, com uma mscara em cada uma de at maxFaces faces
+const int maxFaces = 4;
+VideoFaceDetector detector(classifierFaces, cap.capture());
 Point circleCenter = Point(0, 0);
 int circleRadius = 2;
 Rect faceRectangle;
@@ -138,30 +203,43 @@ float periodoOrbital = 1.0;
 float moonOrbitIterator = 0;
 GLuint textures[2];
 
-//Modo 3, Instagram masks - gesto de texturas
+//Modo 3, Instagram masks - gesto de texturas (todas as mscaras partilham um atlas)
 const int nFacetextures = 4;
-GLuint faceDetectionTextures[nFacetextures];
+TextureAtlas faceAtlas;
+int faceDetectionTextures[nFacetextures];
 int faceTextureAtual = 0;
 
-//Usado para implementar um rolling moving average de modo a limpar o sinal 
+//Usado para implementar um rolling moving average de modo a limpar o sinal (modo das mscaras)
 float newValuesWeight = 1.0;
-float accumulatorX = 0, accumulatorY = 0, accumulatorZ = 0;
+//Um rolling moving average (x, y, escala) por face seguida, pelo id da face
+map<int, Point3f> faceAccumulators;
 
 //Usado para implementar o marker detection (biblioteca Aruco)
 MarkerDetector MDetector;
 vector<Marker> Markers;
 CameraParameters CamParam;
+//Remoo da distoro da lente no modo 4 (tecla U): cv::undistort, remap com mapas em cache ou s nos cantos dos marcadores
+MarkerUndistortion markerUndistortion;
+const char *undistortModeNames[] = { "cv::undistort em cada frame", "remap com mapas em cache", "so nos cantos dos marcadores" };
 
 //Modelos 3D para o modo de marker detection
 const int nModelos = 7;
 int modeloAtual = 0;
 GLMmodel* pmodel[nModelos];
 
+//Imagem da camara desenhada como textura no fundo dos modos 2, 3 e 4
+CameraBackground cameraBackground;
+
+//Gravao do output (camara + objetos renderizados) para ficheiro de video
+VideoRecorder recorder;
+int nGravacoes = 0;
+
 #pragma endregion
 
 #pragma region Methods Declaration
 
 void floorAndWallsDL(void);
+void updateTimings(void);
 void applymaterial(int type);
 
 #pragma endregion
@@ -523,126 +601,59 @@ void glRenderString(float x, float y, char str[])
 	glEnable(GL_LIGHTING);
 }
 
+//Escreve texto em coordenadas da janela (pixeis, origem no canto inferior esquerdo)
+void glRenderText(int x, int y, const char *str)
+{
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glWindowPos2i(x, y);
+	glutBitmapString(GLUT_BITMAP_HELVETICA_12, (const unsigned char *)str);
+}
+
 //Tranforma coordenadas de ecr em coordenadas do mundo
 float ScreenToWorld(float input, float input_start, float input_end, float output_start, float output_end, float divisor){
 	double slope = 1.0 * (output_end - output_start) / (input_end - input_start);
 	return (output_start + slope * (input - input_start)) / divisor;
 }
 
-//Filtra um imagem da camara por uma determinada cor, configuravel em runtime
-void ColorFilter(Mat& source, Mat& destination){
-	inRange(source, Scalar(iLowH, iLowS, iLowV), Scalar(iHighH, iHighS, iHighV), destination); //Threshold the image
-
-	//morphological opening (remove small objects from the foreground)
-	erode(destination, destination, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-	dilate(destination, destination, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-
-	//morphological closing (fill small holes in the foreground)
-	dilate(destination, destination, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
-	erode(destination, destination, getStructuringElement(MORPH_ELLIPSE, Size(5, 5)));
+//Suaviza a posio / raio do objeto detetado pela pipeline de tracking, de acordo com o modo atual
+void ApplyObjectDetection(const vector<BlobDetection>& blobs, int64 captureTicks)
+{
+	switch (demoMode)
+	{
+	case 0:{
+		//Positional Tracking, posio e raio bem suavizados
+		ballTracker.setNoise(1e5, 25.0, 1e4, 16.0);
+		break;
+	}
+	case 1:{
+		//Realidade aumentada, planeta por cima da bola
+		//X e Y acompanham quase instantaneamente, limpamos o ruido do raio do planeta
+		ballTracker.setNoise(1e6, 1.0, 1e4, 4.0);
+		break;
+	}
+	default:
+		return;
+	}
 
+	//Associa as bolas deste frame s do anterior (as que no aparecem mantm a ltima previso)
+	ballTracker.update(blobs, captureTicks / getTickFrequency());
 }
 
-//Detecta um objeto colorido atravs da utilizao dos metodos findContours, approxPolyDP e minEnclosingCircle
-void ObjectDetection(Mat& src_gray, Mat& src_display)
+//Posio / raio das bolas previstos para o instante atual, a partir das ltimas detees
+void PredictObjectPosition()
 {
+	const BlobTrack *primary = ballTracker.primary();
+	if (primary == NULL) return;
 
-	int largest_area = 0;
-	int largest_contour_index = 0;
-	RNG rng(12345);
-	Scalar color;
-
-	vector<vector<Point>> contours; // Vector para guardar os contornos encontrados
-	vector<Vec4i> hierarchy;
-
-	// Encontrar os contornos na imagem
-	findContours(src_gray, contours, hierarchy, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_SIMPLE); 
-
-	if (contours.size() > 0){
+	double time = getTickCount() / getTickFrequency();
+	circleCenter = Point((int)primary->x.predict(time), (int)primary->y.predict(time));
+	circleRadius = (int)primary->radius.predict(time);
 
-		//Foram encontrados contornos
-		//cout << contours.size() << endl;
-
-		//Guardar o indice do maior contorno
-		for (int i = 0; i < contours.size(); i++)
-		{
-			double a = contourArea(contours[i], false);
-			if (a>largest_area){
-				largest_area = a;
-				largest_contour_index = i;
-			}
-		}
-
-		//cout << largest_contour_index << endl << endl;
-
-		vector<vector<Point> > contours_poly(contours.size());
-		vector<Point2f>center(contours.size());
-		vector<float>radius(contours.size());
-
-		approxPolyDP(Mat(contours[largest_contour_index]), contours_poly[largest_contour_index], 3, true);
-		minEnclosingCircle((Mat)contours_poly[largest_contour_index], center[largest_contour_index], radius[largest_contour_index]);
-
-		//Encontramos um circulo
-		/*for (int i = 0; i< contours.size(); i++)
-		{
-		drawContours(src_display, contours_poly, i, Scalar(0, 0, 0), 1, 8, vector<Vec4i>(), 0, Point());
-		}*/
-		if ((int)radius[largest_contour_index] > 15)
-		{
-			/*circle(src_display, center[largest_contour_index], (int)radius[largest_contour_index], Scalar(255, 0, 0), 2, 8, 0);
-			circle(src_display, center[largest_contour_index], 5, Scalar(255, 0, 0), -1);*/
-
-			switch (demoMode)
-			{
-			case 0:{
-				newValuesWeight = 0.4;
-				//Positional Tracking
-				accumulatorX = (newValuesWeight * center[largest_contour_index].x) + (1.0 - newValuesWeight) * accumulatorX;
-				accumulatorY = (newValuesWeight * center[largest_contour_index].y) + (1.0 - newValuesWeight) * accumulatorY;
-				accumulatorZ = (newValuesWeight * (int)radius[largest_contour_index]) + (1.0 - newValuesWeight) * accumulatorZ;
-				circleCenter = Point(accumulatorX, accumulatorY);
-				circleRadius = accumulatorZ;
-				break;
-			}
-			case 1:{
-				//Realidade aumentada, planeta por cima da bola
-				//X e Y acompanham instantaneamente, limpamos o ruido do raio do planeta
-				newValuesWeight = 1.0;
-				accumulatorX = (newValuesWeight * center[largest_contour_index].x) + (1.0 - newValuesWeight) * accumulatorX;
-				accumulatorY = (newValuesWeight * center[largest_contour_index].y) + (1.0 - newValuesWeight) * accumulatorY;
-				circleCenter = Point(accumulatorX, accumulatorY);
-				newValuesWeight = 0.8;
-				accumulatorZ = (newValuesWeight * (int)radius[largest_contour_index]) + (1.0 - newValuesWeight) * accumulatorZ;
-				circleRadius = accumulatorZ;
-				break;
-			}
-			default:
-				break;
-			}
-
-		}
+	otherBalls.clear();
+	for (const BlobTrack &track : ballTracker.tracks()){
+		if (&track == primary) continue;
+		otherBalls.push_back(Vec3f((float)track.x.predict(time), (float)track.y.predict(time), (float)track.radius.predict(time)));
 	}
-
-	///HoughDetection - Extremamente lento e com muitas falhas!
-
-	//// will hold the results of the detection
-	//std::vector<Vec3f> circles;
-	//// runs the actual detection
-	//HoughCircles(src_gray, circles, CV_HOUGH_GRADIENT, 1, src_gray.rows / 16, cannyThreshold, accumulatorThreshold, 5, 800);
-	//for (size_t i = 0; i < circles.size(); i++)
-	//{
-	//	Point center(cvRound(circles[i][0]), cvRound(circles[i][1]));
-	//	int radius = cvRound(circles[i][2]);
-	//	// circle center
-	//	circle(src_display, center, 3, Scalar(0, 255, 0), -1, 8, 0);
-	//	// circle outline
-	//	circle(src_display, center, radius, Scalar(0, 0, 255), 3, 4, 0);
-	//}
-
-	//Flip and show the control window
-	//flip(src_gray, controlFlipped, 0);
-
-
 }
 
 #pragma endregion
@@ -655,30 +666,23 @@ void display()
 	// clear the window
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	// read a new frame from video
-	if (frameCapturedSuccessfully) //if not success, break loop
-	{
-		if (demoMode == 0 || demoMode == 1){
-			cvtColor(frameOriginal, frameHSV, COLOR_BGR2HSV); //Convert the captured frame from BGR to HSV
-
-			//Filtrar para deixar apenas coisas avermelhadas
-			ColorFilter(frameHSV, frameFiltered);
-
-			//Retirar o background
-			pMOG->operator()(frameFiltered, fgMaskMOG);
-
-			//Blur para suavizar as fronteiras
-			GaussianBlur(fgMaskMOG, frameFiltered, Size(9, 9), 4, 4);
-
-			flip(frameFiltered, controlFlipped, 1);
-			imshow("Control", controlFlipped);
+	if (demoMode == 0 || demoMode == 1){
+		//Enviar os frames novos para a pipeline (filtro de cor, MOG + blur e contornos correm noutras threads)
+		//Com a cena parada, as bolas continuam onde a ltima deteo as encontrou
+		if (newFrame && --framesUntilDetection <= 0 && motionGate.update(frameContext)){
+			ColorRange range = { iLowH, iHighH, iLowS, iHighS, iLowV, iHighV };
+			trackingPipeline.submit(frameOriginal, frameCaptureTicks, range);
+			framesUntilDetection = detectionInterval;
+		}
 
-			//runs the detection, and update the display
-			ObjectDetection(frameFiltered, frameOriginal);
+		//Aplicar os resultados j prontos de frames anteriores
+		PipelineFrame *result;
+		while ((result = trackingPipeline.poll()) != NULL){
+			imshow("Control", result->control);
+			ApplyObjectDetection(result->blobs, result->captureTicks);
+			trackingPipeline.release(result);
 		}
-	}
-	else{
-		cout << "No frame captured!" << endl;
+		PredictObjectPosition();
 	}
 
 	glViewport(0, 0, width, height);
@@ -739,6 +743,7 @@ void display()
 		glRenderString(0.0f, 6.0f, "Pode configurar a cor a detetar");
 		glRenderString(0.0f, 8.0f, "com os sliders da janela Controlo.");
 		glRenderString(0.0f, 10.0f, "Tecla M para mudar de modo");
+		glRenderString(0.0f, 12.0f, motionGate.enabled() ? "Tecla G: detecao so com movimento (ligada)" : "Tecla G: detecao so com movimento (desligada)");
 
 		break;
 	case 1:
@@ -751,14 +756,14 @@ void display()
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
 
-		//Desenhar a imagem da camara
-		flip(frameOriginal, tempimage, 0);
-		flip(tempimage, tempimage2, 1);
-		putText(tempimage2, "Modo 2 - Augmented Reality", cvPoint(10, height - 20), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(tempimage2, "Utilize um objeto vermelho (de preferencia uma esfera).", cvPoint(10, height - 40), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(tempimage2, "Pode alterar a cor a detetar com os sliders da janela Controlo", cvPoint(10, height - 60), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(tempimage2, "Tecla M para passar ao proximo modo", cvPoint(10, height - 80), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		glDrawPixels(tempimage2.size().width, tempimage2.size().height, GL_BGR, GL_UNSIGNED_BYTE, tempimage2.ptr());
+		//Desenhar a imagem da camara (espelhada atravs das coordenadas de textura)
+		if (newFrame) cameraBackground.upload(frameOriginal);
+		cameraBackground.draw(true, true);
+		glRenderText(10, height - 20, "Modo 2 - Augmented Reality");
+		glRenderText(10, height - 40, "Utilize um objeto vermelho (de preferencia uma esfera).");
+		glRenderText(10, height - 60, "Pode alterar a cor a detetar com os sliders da janela Controlo");
+		glRenderText(10, height - 80, "Tecla M para passar ao proximo modo");
+		glRenderText(10, height - 100, motionGate.enabled() ? "Tecla G: detecao so com movimento (ligada)" : "Tecla G: detecao so com movimento (desligada)");
 
 		//Limpar o depth buffer
 		glClear(GL_DEPTH_BUFFER_BIT);
@@ -797,6 +802,17 @@ void display()
 
 		glPopMatrix();
 
+		//Um planeta por cada uma das outras bolas seguidas
+		for (const Vec3f &ball : otherBalls){
+			glPushMatrix();
+			glTranslatef(ScreenToWorld(ball[0], 0.0, (float)width, -width / 2.0, width / 2.0, width / 2.65),
+				-ScreenToWorld(ball[1], 0.0, (float)height, -height / 2.0, height / 2.0, height / 2.0), 0);
+			glRotatef(-spin, 0.0, 1.0, 0.0);
+			glRotatef(-90.0, 1.0, 0.0, 0.0);
+			gluSphere(mysolid, ball[2] / (height / 2.0), 64, 64);
+			glPopMatrix();
+		}
+
 
 		glPushMatrix();
 
@@ -854,13 +870,16 @@ void display()
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
 
-		//Desenhar a imagem da camara
-		flip(frameOriginal, tempimage, 0);
-		flip(tempimage, tempimage2, 1);
-		putText(tempimage2, "Modo 3 - Face Detection", cvPoint(10, height - 20), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(tempimage2, "Tecla N para alterar a textura", cvPoint(10, height - 40), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(tempimage2, "Tecla M para passar ao proximo modo", cvPoint(10, height - 60), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		glDrawPixels(tempimage2.size().width, tempimage2.size().height, GL_BGR, GL_UNSIGNED_BYTE, tempimage2.ptr());
+		//Desenhar a imagem da camara (espelhada atravs das coordenadas de textura)
+		if (newFrame) cameraBackground.upload(frameOriginal);
+		cameraBackground.draw(true, true);
+		glRenderText(10, height - 20, "Modo 3 - Face Detection");
+		glRenderText(10, height - 40, "Tecla N para alterar a textura");
+		glRenderText(10, height - 60, "Tecla M para passar ao proximo modo");
+		glRenderText(10, height - 80, detector.async() ? "Tecla A: cascade numa thread propria (ligada)" : "Tecla A: cascade numa thread propria (desligada)");
+		glRenderText(10, height - 100, detector.trackingMethod() == VideoFaceDetector::OPTICAL_FLOW ? "Tecla F: seguimento por fluxo otico (KLT)" : "Tecla F: seguimento por template matching");
+		glRenderText(10, height - 120, (string("Tecla V: faces seguidas ate ") + to_string(detector.maxFaces())).c_str());
+		glRenderText(10, height - 140, motionGate.enabled() ? "Tecla G: detecao so com movimento (ligada)" : "Tecla G: detecao so com movimento (desligada)");
 
 		glClear(GL_DEPTH_BUFFER_BIT);
 
@@ -879,58 +898,48 @@ void display()
 
 		glColor4f(1.0, 1.0, 1.0, 1.0);
 
-		//Aplicar textura
-		glBindTexture(GL_TEXTURE_2D, faceDetectionTextures[faceTextureAtual]);
-
 		//Aplicar materiais e luzes
 		applymaterial(0);
 		applylights();
 
-		glPushMatrix();
-		//Rectangulo que envolve a face detectada
-		Rect face = detector.face();
-		//Posio central da face
-		Point facePos = detector.facePosition();
-
-		//Escrever valores
-		//cout << face.width << endl;
-
-		float scale = ScreenToWorld((float)face.width, 80.0, 480.0, 0.35, 1.4, 1.0);
-
-		newValuesWeight = 0.3;
-		accumulatorZ = (newValuesWeight * scale) + (1.0 - newValuesWeight) * accumulatorZ;
-
-		//Dar a escala correcta  textura aplicada
-		glScalef(accumulatorZ, accumulatorZ, 0);
-
-		//Escrever valores
-		//cout << facePos.x << " x " << facePos.y << endl;
+		//Uma mscara em cada face seguida
+		vector<TrackedFace> faces = detector.faces();
+		map<int, Point3f> accumulators;
+		for (size_t i = 0; i < faces.size(); i++){
+			//Rectangulo que envolve a face detectada
+			Rect face = faces[i].face;
+			//Posio central da face
+			Point facePos = faces[i].position;
+
+			float scale = ScreenToWorld((float)face.width, 80.0, 480.0, 0.35, 1.4, 1.0);
+			//Colocar a textura no sitio certo
+			float faceCenterX = ScreenToWorld((float)facePos.x, 10, 640, -width / 2.0, width / 2.0, 180);
+			float faceCenterY = -ScreenToWorld((float)facePos.y, 40, 480, -height / 2.0, height / 2.0, 180);
+
+			//Uma face nova comea j na sua posio
+			map<int, Point3f>::iterator anterior = faceAccumulators.find(faces[i].id);
+			Point3f accumulator = anterior != faceAccumulators.end() ? anterior->second : Point3f(faceCenterX, faceCenterY, scale);
+
+			newValuesWeight = 0.3;
+			accumulator.z = (newValuesWeight * scale) + (1.0 - newValuesWeight) * accumulator.z;
+			newValuesWeight = 0.5;
+			accumulator.x = (newValuesWeight * faceCenterX) + (1.0 - newValuesWeight) * accumulator.x;
+			accumulator.y = (newValuesWeight * faceCenterY) + (1.0 - newValuesWeight) * accumulator.y;
+			accumulators[faces[i].id] = accumulator;
 
-		//Colocar a textura no sitio certo
-		float faceCenterX = ScreenToWorld((float)facePos.x, 10, 640, -width / 2.0, width / 2.0, 180);
-		float faceCenterY = -ScreenToWorld((float)facePos.y, 40, 480, -height / 2.0, height / 2.0, 180);
-
-		newValuesWeight = 0.5;
-
-		accumulatorX = (newValuesWeight * faceCenterX) + (1.0 - newValuesWeight) * accumulatorX;
-		accumulatorY = (newValuesWeight * faceCenterY) + (1.0 - newValuesWeight) * accumulatorY;
-
-		//cout << faceCenterX << " x " << faceCenterY << endl << endl;
+			glPushMatrix();
+			//Dar a escala correcta  textura aplicada
+			glScalef(accumulator.z, accumulator.z, 0);
+			glTranslatef(accumulator.x, accumulator.y, 0);
 
-		glTranslatef(accumulatorX, accumulatorY, 0);
+			//Desenhar a textura num quad, com as coordenadas de textura da mscara dentro do atlas
+			faceAtlas.drawQuad(faceDetectionTextures[faceTextureAtual]);
+			glPopMatrix();
+		}
+		//As faces perdidas deixam de ter mdia
+		faceAccumulators.swap(accumulators);
 
-		//Desenhar a textura num quad
-		glBegin(GL_QUADS);
-			glTexCoord2f(0.0f, 0.0f);
-			glVertex3f(-1.0f, -1.0f, 0.0f);
-			glTexCoord2f(1.0f, 0.0f); // sempre 1.0f se quiser aplicar toda a textura
-			glVertex3f(1.0f, -1.0f, 0.0f);
-			glTexCoord2f(1.0f, 1.0f);
-			glVertex3f(1.0f, 1.0f, 0.0f);
-			glTexCoord2f(0.0f, 1.0f);
-			glVertex3f(-1.0f, 1.0f, 0.0f);
-			glEnd();
-		glPopMatrix();
+		faceAtlas.unbind();
 
 		break;
 	}
@@ -946,20 +955,33 @@ void display()
 		glMatrixMode(GL_MODELVIEW);
 		glLoadIdentity();
 
-		flip(frameOriginal, tempimage, 0);
-		flip(tempimage, tempimage2, 1);
+		if (newFrame){
+			//Rodar a imagem 180 graus (os marcadores so detetados nesta orientao)
+			flip(frameOriginal, tempimage, -1);
+
+			//Detetar marcadores, tirando a distoro da lente  imagem ou s aos cantos dos marcadores
+			markerFrameContext.reset(tempimage);
+			if (motionGate.update(markerFrameContext)){
+				markerUndistortion.detect(MDetector, markerFrameContext, CamParam, 0.045, Markers, undistorted);
+			}
+			else{
+				//Cena parada: os marcadores e poses da ltima deteo continuam vlidos, s a imagem  nova
+				markerUndistortion.drawingBackground(tempimage, CamParam, undistorted);
+			}
 
-		//Fazer undistort  imagem de acordo com os parametros da camara
-		cv::undistort(tempimage2, undistorted, CamParam.CameraMatrix, CamParam.Distorsion);
+			cameraBackground.upload(undistorted);
+		}
 
-		//Detetar marcadores
-		MDetector.detect(undistorted, Markers, CamParam, 0.045);
 		//Desenhar imagem da camara
-
-		putText(undistorted, "Modo 4 - Marker Detection", cvPoint(10, height - 20), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(undistorted, "Tecla N para alterar o modelo 3D", cvPoint(10, height - 40), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		putText(undistorted, "Tecla M para passar ao proximo modo", cvPoint(10, height - 60), CV_FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 255, 255), 1, 8, true);
-		glDrawPixels(undistorted.size().width, undistorted.size().height, GL_BGR, GL_UNSIGNED_BYTE, undistorted.ptr());
+		cameraBackground.draw(false, false);
+		glRenderText(10, height - 20, "Modo 4 - Marker Detection");
+		glRenderText(10, height - 40, "Tecla N para alterar o modelo 3D");
+		glRenderText(10, height - 60, "Tecla M para passar ao proximo modo");
+		glRenderText(10, height - 80, (string("Tecla U para alterar o undistort: ") + undistortModeNames[markerUndistortion.mode()]).c_str());
+		glRenderText(10, height - 100, markerUndistortion.search().enabled() ? "Tecla T: procura em janelas a volta dos marcadores (ligada)" : "Tecla T: procura em janelas a volta dos marcadores (desligada)");
+		glRenderText(10, height - 120, markerUndistortion.search().parallel() ? "Tecla P: detecao de marcadores em paralelo (ligada)" : "Tecla P: detecao de marcadores em paralelo (desligada)");
+		glRenderText(10, height - 140, markerUndistortion.poses().enabled() ? "Tecla E: pose a partir da do frame anterior (ligada)" : "Tecla E: pose a partir da do frame anterior (desligada)");
+		glRenderText(10, height - 160, motionGate.enabled() ? "Tecla G: detecao so com movimento (ligada)" : "Tecla G: detecao so com movimento (desligada)");
 		glClear(GL_DEPTH_BUFFER_BIT);
 
 		double proj_matrix[16];
@@ -1005,13 +1027,59 @@ void display()
 		break;
 	}
 
+	//Copiar o frame para a gravao (assncrono, no bloqueia o render)
+	recorder.grab();
+
 	// show the rendering on the screen
 	glutSwapBuffers();
 
+	updateTimings();
+	newFrame = false;
+
 	// post the next redisplay
 	glutPostRedisplay();
 }
 
+//Conta os frames renderizados e a latncia entre a captura e o ecr dos frames novos
+void updateTimings()
+{
+	int64 now = getTickCount();
+	if (statsStartTicks == 0) statsStartTicks = now;
+
+	renderedFrames++;
+	if (newFrame){
+		displayedFrames++;
+		latencySum += (now - frameCaptureTicks) / getTickFrequency();
+	}
+
+	double elapsed = (now - statsStartTicks) / getTickFrequency();
+	if (elapsed >= 1.0){
+		cout << "Render: " << renderedFrames / elapsed << " fps | Camara: " << displayedFrames / elapsed << " fps ("
+			<< grabber.framesSkipped() << " frames ignorados) | Latencia captura-ecra: "
+			<< (displayedFrames > 0 ? latencySum / displayedFrames * 1000.0 : 0.0) << " ms" << endl;
+		if (demoMode == 0 || demoMode == 1){
+			StageTimings t = trackingPipeline.timings();
+			cout << "Pipeline: filtro " << t.threshold * 1000.0 << " ms | mog+blur " << t.background * 1000.0
+				<< " ms | contornos " << t.contours * 1000.0 << " ms | latencia " << t.latency * 1000.0 << " ms | janela "
+				<< t.windowArea * 100.0 << "% do frame | " << t.frames << " frames, " << t.dropped << " descartados" << endl;
+		}
+		if (demoMode == 2){
+			FaceTimings t = detector.timings();
+			cout << "Faces: seguimento " << t.tracking * 1000.0 << " ms/frame | cascade " << t.cascade * 1000.0 << " ms ("
+				<< t.cascadePasses << " passagens, " << t.stale << " atrasadas) | " << t.faces << " faces | " << (detector.async() ? "cascade em paralelo" : "cascade no idle")
+				<< (detector.trackingMethod() == VideoFaceDetector::OPTICAL_FLOW ? ", fluxo otico" : ", template matching") << endl;
+		}
+		if (motionGate.executed() + motionGate.skipped() > 0){
+			cout << "Detecoes: " << motionGate.executed() << " executadas, " << motionGate.skipped() << " saltadas por falta de movimento"
+				<< (motionGate.enabled() ? "" : " (desligado)") << endl;
+			motionGate.resetCounters();
+		}
+		statsStartTicks = now;
+		renderedFrames = displayedFrames = 0;
+		latencySum = 0;
+	}
+}
+
 //Callback de reshape da janela glut
 void reshape(int w, int h)
 {
@@ -1035,6 +1103,9 @@ void keyboard(unsigned char key, int x, int y)
 	{
 	case 'q':
 		// quit when q is pressed
+		recorder.stop();
+		grabber.stop();
+		trackingPipeline.stop();
 		exit(0);
 		break;
 	case 'm':
@@ -1042,9 +1113,88 @@ void keyboard(unsigned char key, int x, int y)
 		if (demoMode >= demoModes){
 			demoMode = 0;
 		}
-		accumulatorX = 0;
-		accumulatorY = 0;
-		accumulatorZ = 0;
+		faceAccumulators.clear();
+		motionGate.reset();
+		ballTracker.reset();
+		otherBalls.clear();
+		trackingPipeline.searchWindow().reset();
+		break;
+	case '+':
+		detectionInterval += 1;
+		cout << "Detecao a cada " << detectionInterval << " frames" << endl;
+		break;
+	case '-':
+		detectionInterval = std::max(detectionInterval - 1, 1);
+		cout << "Detecao a cada " << detectionInterval << " frames" << endl;
+		break;
+	case 'g':
+		//Liga / desliga a deteo s quando h movimento na imagem
+		motionGate.setEnabled(!motionGate.enabled());
+		cout << "Detecao so com movimento: " << (motionGate.enabled() ? "ligada" : "desligada") << endl;
+		break;
+	case 'w':
+		//Liga / desliga a procura da bola s numa janela  volta da posio prevista
+		trackingPipeline.searchWindow().setEnabled(!trackingPipeline.searchWindow().enabled());
+		cout << "Janela de procura: " << (trackingPipeline.searchWindow().enabled() ? "ligada" : "desligada") << endl;
+		break;
+	case 'u':
+		if (demoMode == 3){
+			markerUndistortion.setMode((MarkerUndistortion::Mode)((markerUndistortion.mode() + 1) % MarkerUndistortion::MODES));
+		}
+		break;
+	case 'c':{
+		if (demoMode == 3){
+			//Resoluo da procura de marcadores: automtica, 1, 1/2 ou 1/4 (cantos refinados na resoluo total)
+			int escala = markerUndistortion.search().scale();
+			escala = escala == 0 ? 1 : (escala == 4 ? 0 : escala * 2);
+			markerUndistortion.search().setScale(escala);
+			cout << "Escala da procura de marcadores: " << (escala == 0 ? string("automatica") : "1/" + to_string(escala)) << endl;
+		}
+		break;
+	}
+	case 't':
+		if (demoMode == 3){
+			//Procura dos marcadores s em janelas  volta dos do frame anterior, ou no frame inteiro
+			markerUndistortion.search().setEnabled(!markerUndistortion.search().enabled());
+		}
+		break;
+	case 'p':
+		if (demoMode == 3){
+			//Deteo dos marcadores repartida pelos ncleos, ou a deteo da aruco numa s thread
+			markerUndistortion.search().setParallel(!markerUndistortion.search().parallel());
+		}
+		break;
+	case 'e':
+		if (demoMode == 3){
+			//Pose de cada marcador estimada a partir da do frame anterior, ou do zero em cada frame
+			markerUndistortion.poses().setEnabled(!markerUndistortion.poses().enabled());
+		}
+		break;
+	case 'a':
+		if (demoMode == 2){
+			//Cascade de faces numa thread prpria (o idle s segue a face) ou dentro do idle
+			detector.setAsync(!detector.async());
+		}
+		break;
+	case 'f':
+		if (demoMode == 2){
+			//Seguimento da face entre cascades: pontos seguidos com Lucas-Kanade ou template matching
+			detector.setTrackingMethod(detector.trackingMethod() == VideoFaceDetector::OPTICAL_FLOW ? VideoFaceDetector::TEMPLATE_MATCHING : VideoFaceDetector::OPTICAL_FLOW);
+		}
+		break;
+	case 'v':
+		if (demoMode == 2){
+			//Alterna entre uma mscara s (a maior face) e mscaras em at maxFaces faces
+			detector.setMaxFaces(detector.maxFaces() > 1 ? 1 : maxFaces);
+			cout << "Faces seguidas: " << detector.maxFaces() << endl;
+		}
+		break;
+	case 'o':
+		//Alterna entre seguir s a maior bola e seguir at maxBolas bolas
+		ballTracker.setMaxTracks(ballTracker.maxTracks() > 1 ? 1 : maxBolas);
+		trackingPipeline.setMaxBlobs(ballTracker.maxTracks());
+		otherBalls.clear();
+		cout << "Bolas seguidas: " << ballTracker.maxTracks() << endl;
 		break;
 	case 'n':
 		if (demoMode == 2){
@@ -1060,27 +1210,43 @@ void keyboard(unsigned char key, int x, int y)
 			}
 		}
 		break;
+	case 'r':
+		if (recorder.isRecording()){
+			//Escreve os frames em fila e mostra quantos foram descartados
+			recorder.stop();
+		}
+		else{
+			recorder.start("gravacao_" + to_string(nGravacoes++) + ".avi", width, height, cap.rate());
+		}
+		break;
 
 	default:
 		break;
 	}
 }
 
-//Leitura de um novo frame a partir da camara
+//Recolhe o frame mais recente da thread de captura, sem bloquear
 void idle()
 {
-	//recolher um novo frame da camara
-	if (demoMode == 2){
-		//deteo de faces
-		detector >> frameOriginal;
-	}
-	else{
-		//outros modos
-		frameCapturedSuccessfully = cap.read(frameOriginal);
-	}
+	if (!grabber.update()) return;
+
+	//O frame fica reservado para o render at  prxima chamada a update()
+	frameOriginal = grabber.frame().image;
+	frameCaptureTicks = grabber.frame().captureTicks;
+	frameCapturedSuccessfully = true;
+	newFrame = true;
 
 	CamParam.resize(frameOriginal.size());
+	frameContext.reset(frameOriginal);
 
+	if (demoMode == 2){
+		//deteo de faces quando h movimento, e sempre que a cascade tem resultados por recolher
+		//O gate v todos os frames, para a sua referncia no ficar desatualizada enquanto a cascade corre
+		bool movimento = motionGate.update(frameContext);
+		if (movimento || detector.cascadePending()){
+			detector.detect(frameContext);
+		}
+	}
 }
 
 #pragma endregion
@@ -1090,13 +1256,189 @@ void idle()
 #pragma region Entry Point
 int main(int argc, char** argv)
 {
-	if (!cap.isOpened())
+	//"--bench-filter" compara o filtro de cor fundido com a sequncia de chamadas do OpenCV
+	for (int i = 1; i < argc; i++){
+		if (strcmp(argv[i], "--bench-filter") == 0){
+			ColorTracker::benchmarkFilter(Size(640, 480), 200);
+			ColorTracker::benchmarkFilter(Size(1920, 1080), 50);
+			return 0;
+		}
+		//"--bench-blob" compara a anlise de blobs numa s passagem com findContours
+		if (strcmp(argv[i], "--bench-blob") == 0){
+			ColorTracker::benchmarkDetect(Size(640, 480), 500);
+			ColorTracker::benchmarkDetect(Size(1920, 1080), 100);
+			return 0;
+		}
+		//"--bench-undistort" compara cv::undistort, o remap com mapas em cache e o undistort s dos cantos
+		if (strcmp(argv[i], "--bench-undistort") == 0){
+			CameraParameters params;
+			params.readFromXMLFile("camera.xml");
+			MarkerUndistortion::benchmark(params, 200);
+			return 0;
+		}
+		//"--bench-pose" compara o tempo e a estabilidade da pose calculada do zero e a partir do frame anterior
+		if (strcmp(argv[i], "--bench-pose") == 0){
+			CameraParameters params;
+			params.readFromXMLFile("camera.xml");
+			MarkerPoseTrackers::benchmark(params, 0.045f, 500);
+			return 0;
+		}
+		//"--bench-markers" compara a deteo de marcadores no frame inteiro com a procura em janelas
+		if (strcmp(argv[i], "--bench-markers") == 0){
+			MarkerRoiDetector::benchmark(Size(640, 480), 1, 200);
+			MarkerRoiDetector::benchmark(Size(640, 480), 6, 200);
+			MarkerRoiDetector::benchmark(Size(1920, 1080), 1, 50);
+			MarkerRoiDetector::benchmark(Size(1920, 1080), 6, 50);
+			MarkerRoiDetector::benchmarkScale(Size(1920, 1080), 2, 50);
+			MarkerRoiDetector::benchmarkScale(Size(1920, 1080), 4, 50);
+			return 0;
+		}
+		//"--bench-parallel-markers" compara a deteo da aruco com a deteo em paralelo, com 1, 10 e 50 marcadores,
+		//e termina com erro se os ids ou os cantos no forem os mesmos
+		if (strcmp(argv[i], "--bench-parallel-markers") == 0){
+			bool iguais = ParallelMarkerDetector::benchmark(Size(1920, 1080), 1, 30);
+			iguais = ParallelMarkerDetector::benchmark(Size(1920, 1080), 10, 30) && iguais;
+			iguais = ParallelMarkerDetector::benchmark(Size(1920, 1080), 50, 30) && iguais;
+			return iguais ? 0 : 1;
+		}
+		//"--bench-background" compara o glDrawPixels com a textura para o fundo da camara
+		//Precisa s de uma janela OpenGL, no da camara
+		if (strcmp(argv[i], "--bench-background") == 0){
+			glutInit(&argc, argv);
+			glutInitDisplayMode(GLUT_DOUBLE | GLUT_DEPTH | GLUT_RGBA);
+			glutInitWindowSize(640, 480);
+			glutCreateWindow("OpenGL / OpenCV Example");
+			glewInit();
+			CameraBackground::benchmark(Size(640, 480), 200);
+			CameraBackground::benchmark(Size(1920, 1080), 100);
+			return 0;
+		}
+		//"--bench-lut" compara a tabela de cores BGR com cvtColor + filtro HSV
+		if (strcmp(argv[i], "--bench-lut") == 0){
+			ColorTracker::benchmarkLut(Size(640, 480), 200);
+			ColorTracker::benchmarkLut(Size(1920, 1080), 50);
+			return 0;
+		}
+	}
+
+	//"--source <video | padrao%04d.png | indice da camara>" substitui a webcam, "--fps <n>" simula essa taxa de frames,
+	//"--unpaced" l o mais depressa possvel, "--loop" repete o ficheiro e "--seek <n>" comea nesse frame
+	string sourcePath = "0";
+	string headlessMode, logPath, batchMode, outputDirectory;
+	vector<string> batchFiles;
+	ResultWriter::Format resultFormat = ResultWriter::CSV;
+	int workers = 0;
+	long long headlessFrames = 0, seekFrame = 0;
+	bool loop = false, gate = true;
+	FrameSource::Pacing pacing = FrameSource::NATIVE;
+	double fps = 0;
+	for (int i = 1; i < argc; i++){
+		string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--source" && hasValue) sourcePath = argv[++i];
+		else if (arg == "--fps" && hasValue){ pacing = FrameSource::FIXED; fps = atof(argv[++i]); }
+		else if (arg == "--unpaced") pacing = FrameSource::UNPACED;
+		else if (arg == "--loop") loop = true;
+		else if (arg == "--seek" && hasValue) seekFrame = atoll(argv[++i]);
+		//"--headless <color | face | marker>" corre s a deteo desse modo, sem janelas, e mostra os tempos de cada etapa;
+		//"--frames <n>" limita os frames processados e "--log <ficheiro.csv>" guarda os tempos de cada frame
+		else if (arg == "--headless" && hasValue) headlessMode = argv[++i];
+		else if (arg == "--frames" && hasValue) headlessFrames = atoll(argv[++i]);
+		else if (arg == "--log" && hasValue) logPath = argv[++i];
+		//"--no-gate" corre a deteo em todos os frames, mesmo sem movimento
+		else if (arg == "--no-gate") gate = false;
+		//"--batch <color | face | marker> video1 video2 ..." corre a deteo nos vdeos, vrios em paralelo, e guarda os
+		//resultados de cada frame em <video>.<modo>.csv; "@lista.txt" l os vdeos de um ficheiro (um por linha),
+		//"--format csv | binary" escolhe o formato, "--workers <n>" as threads e "--out-dir <pasta>" onde ficam
+		else if (arg == "--batch" && hasValue) batchMode = argv[++i];
+		else if (arg == "--format" && hasValue){
+			if (!ResultWriter::parseFormat(argv[++i], resultFormat)){
+				cout << "Unknown result format " << argv[i] << " (csv or binary)" << endl;
+				return -1;
+			}
+		}
+		else if (arg == "--workers" && hasValue) workers = atoi(argv[++i]);
+		else if (arg == "--out-dir" && hasValue) outputDirectory = argv[++i];
+		else if (arg[0] == '@'){
+			ifstream list(arg.substr(1).c_str());
+			string line;
+			while (getline(list, line)){
+				if (!line.empty()) batchFiles.push_back(line);
+			}
+		}
+		else if (arg.compare(0, 2, "--") != 0) batchFiles.push_back(arg);
+	}
+
+	if (!batchMode.empty()){
+		HeadlessRunner::Mode mode;
+		if (!HeadlessRunner::parseMode(batchMode, mode)){
+			cout << "Unknown batch mode " << batchMode << " (color, face or marker)" << endl;
+			return -1;
+		}
+		BatchProcessor batch(mode, classifierFaces);
+		ColorRange range = { iLowH, iHighH, iLowS, iHighS, iLowV, iHighV };
+		batch.setColorRange(range);
+		batch.setFormat(resultFormat);
+		batch.setWorkers(workers);
+		batch.setOutputDirectory(outputDirectory);
+		batch.setMotionGate(gate);
+		try{
+			CamParam.readFromXMLFile("camera.xml");
+		}
+		catch (std::exception &ex){
+			cout << "Exception: " << ex.what() << endl;
+		}
+		batch.setCamera(CamParam, 0.045f);
+		batch.run(batchFiles);
+		return 0;
+	}
+
+	if (!cap.open(sourcePath))
 	{
 		cout << "Cannot open the web cam" << endl;
 		return -1;
 	}
+	cap.setPacing(pacing, fps);
+	cap.setLoop(loop);
+	if (seekFrame > 0 && !cap.seek(seekFrame)){
+		cout << "Cannot seek to frame " << seekFrame << endl;
+		return -1;
+	}
+	motionGate.setEnabled(gate);
 
-	pMOG = new BackgroundSubtractorMOG();
+	if (!headlessMode.empty()){
+		HeadlessRunner::Mode mode;
+		if (!HeadlessRunner::parseMode(headlessMode, mode)){
+			cout << "Unknown headless mode " << headlessMode << " (color, face or marker)" << endl;
+			return -1;
+		}
+		HeadlessRunner runner(cap, mode, classifierFaces);
+		ColorRange range = { iLowH, iHighH, iLowS, iHighS, iLowV, iHighV };
+		runner.setColorRange(range);
+		runner.motionGate().setEnabled(gate);
+		try{
+			CamParam.readFromXMLFile("camera.xml");
+		}
+		catch (std::exception &ex){
+			cout << "Exception: " << ex.what() << endl;
+		}
+		runner.setCamera(CamParam, 0.045f);
+
+		ofstream log;
+		if (!logPath.empty()) log.open(logPath.c_str());
+		runner.run(headlessFrames, log.is_open() ? &log : NULL);
+		runner.printSummary(cout);
+		return 0;
+	}
+
+	if (cap.frameSize().area() > 0){
+		width = cap.frameSize().width;
+		height = cap.frameSize().height;
+		GlWindowSize = Size(width, height);
+	}
+
+	trackingPipeline.setMaxBlobs(ballTracker.maxTracks());
+	trackingPipeline.start();
 
 	//Criar a janela "Controlo"
 	namedWindow("Control", CV_WINDOW_AUTOSIZE);
@@ -1116,6 +1458,9 @@ int main(int argc, char** argv)
 	glutInitWindowSize(width, height);
 	glutCreateWindow("OpenGL / OpenCV Example");
 
+	//Extenses OpenGL (pixel buffer objects)
+	glewInit();
+
 	// Inicializaes
 	init();
 	initLights();
@@ -1124,11 +1469,11 @@ int main(int argc, char** argv)
 	load_tga_image("earth", textures[0], false);
 	load_tga_image("moon", textures[1], false);
 	//Texturas para sobrepor à face detetada
-	glGenTextures(4, faceDetectionTextures);
-	load_tga_image("ironman", faceDetectionTextures[0], true);
-	load_tga_image("mrt", faceDetectionTextures[1], true);
-	load_tga_image("lion", faceDetectionTextures[2], true);
-	load_tga_image("hitler", faceDetectionTextures[3], true);
+	faceDetectionTextures[0] = faceAtlas.add("ironman", "textures/ironman.tga");
+	faceDetectionTextures[1] = faceAtlas.add("mrt", "textures/mrt.tga");
+	faceDetectionTextures[2] = faceAtlas.add("lion", "textures/lion.tga");
+	faceDetectionTextures[3] = faceAtlas.add("hitler", "textures/hitler.tga");
+	faceAtlas.build();
 	//Modelos 3D para o modo de marker detection
 	loadmodel(0, "f-16", 0.05);
 	loadmodel(1, "al", 0.05);
@@ -1153,6 +1498,9 @@ int main(int argc, char** argv)
 	glutKeyboardFunc(keyboard);
 	glutIdleFunc(idle);
 
+	//Iniciar a captura da camara
+	grabber.start();
+
 	//Iniciar o main loop
 	glutMainLoop();
 
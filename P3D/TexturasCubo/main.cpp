@@ -1,10 +1,13 @@
 #define _CRT_SECURE_NO_WARNINGS
 #define _CRT_NONSTDC_NO_DEPRECATE
 
+#include "Dependencies\glew\glew.h"
 #include "Dependencies\freeglut\freeglut.h"
 #include <stdio.h>
+#include <string.h>
 #include <windows.h>
 #include "tga.h"
+#include "cubemap.h"
 
 // Prottipos de funes
 void init(void);
@@ -13,11 +16,10 @@ void pressNormalKeys(unsigned char key, int x, int y);
 void display(void);
 void reshape(GLsizei w, GLsizei h);
 void funcmyDL(void);
-void load_cube_images(void);
+void load_cube_images(int nThreads);
 
 
 // Variveis globais
-tgaInfo *im[6];
 GLuint texture[6];
 int myDL;
 float cubeyangle = 0.0;
@@ -232,22 +234,42 @@ void funcmyDL(void)
 }
 
 
-void load_cube_images(void)
+void load_cube_images(int nThreads)
 {
 	char *impathfile[6] = { "cm_front.tga", "cm_back.tga", "cm_right.tga", "cm_left.tga", "cm_top.tga", "cm_bottom.tga" };
+	GLenum faceTarget[6] = { GL_TEXTURE_2D, GL_TEXTURE_2D, GL_TEXTURE_2D, GL_TEXTURE_2D, GL_TEXTURE_2D, GL_TEXTURE_2D };
+	tgaInfo *im[6] = { NULL };
+	cubeInfo *cube;
+	double start, loadTime;
 	int i;
 
-	// Carrega as imagens de textura
-	for (i = 0; i<6; i++)
+	start = cubeSeconds();
+
+	// Carrega as imagens de textura, todas ao mesmo tempo
+	nThreads = cubeLoadImages(impathfile, 6, im, nThreads);
+	loadTime = cubeSeconds() - start;
+
+	cube = cubeFromImages(im);
+	if (cube == NULL || cube->status != CUBE_OK)
 	{
-		im[i] = tgaLoad(impathfile[i]);
+		printf("Erro ao carregar as faces do cubo\n");
+		exit(1);
+	}
 
+	for (i = 0; i<6; i++)
+	{
 		printf("IMAGE INFO: %s\nstatus: %d\ntype: %d\npixelDepth: %d\nsize%d x %d\n", impathfile[i], im[i]->status, im[i]->type, im[i]->pixelDepth, im[i]->width, im[i]->height); fflush(stdout);
 	}
 
+	// Cria os mipmaps das seis faces em paralelo
+	cubeBuildMipmaps(cube);
+
 	// Cria nomes de texturas
 	glGenTextures(6, texture);
 
+	// Envia todas as faces e mipmaps de uma vez
+	cubeUpload(cube, GL_TEXTURE_2D, texture, faceTarget);
+
 	for (i = 0; i<6; i++)
 	{
 		// Selecciona uma textura
@@ -260,15 +282,14 @@ void load_cube_images(void)
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
-
-		// Cria textura de mipmaps
-		gluBuild2DMipmaps(GL_TEXTURE_2D, 3, im[i]->width, im[i]->height, GL_RGB, GL_UNSIGNED_BYTE, im[i]->imageData);
-		// Se no tem mipmaps
-		//glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, im[i]->width, im[i]->height, 0, GL_RGB, GL_UNSIGNED_BYTE, im[i]->imageData);
 	}
 
+	printf("Texturas prontas em %.1f ms (%d threads): leitura %.1f ms, mipmaps %.1f ms, upload %.1f ms\n",
+		(cubeSeconds() - start) * 1000.0, nThreads, loadTime * 1000.0, cube->mipTime * 1000.0, cube->uploadTime * 1000.0);
+	fflush(stdout);
+
 	// Destroi as imagens
-	for (i = 0; i<6; i++) tgaDestroy(im[i]);
+	cubeDestroy(cube);
 }
 
 
@@ -283,10 +304,14 @@ int main(int argc, char** argv)
 	glutInitWindowSize(640, 480);
 	glutCreateWindow("Programa-23");
 
+	// Necessrio para os pixel buffer objects
+	glewInit();
+
 	// Inicializaes
 	init();
 	initLights();
-	load_cube_images();
+	// "-serial" carrega as imagens uma a uma, para comparar o tempo de arranque
+	load_cube_images(argc > 1 && strcmp(argv[1], "-serial") == 0 ? 1 : 0);
 	initDL();
 
 	// Registar funes de callback